@@ -0,0 +1,370 @@
+// Asynchronous I/O.
+//
+// A process shares one struct aioring (see aio.h) with the kernel.
+// aioenter() takes every request queued on its submission ring,
+// checks it, and appends it to a single queue served by NAIOWORKER
+// kernel threads, so up to NAIOWORKER requests are at the disk at
+// once and the process goes on computing meanwhile.  A worker
+// sleeps in the buffer cache until ideintr() wakes it with the
+// data, then posts the completion straight into the shared page;
+// the process reaps it without a system call, or blocks for it in
+// aioenter().
+//
+// aioenter() pins every page of a request's buffer with uvmpin()
+// in the owner's own context, breaking copy-on-write sharing first
+// for a read, so workers move data through the pages' kernel
+// addresses and never look at, or change, the owner's page table.
+// The pages stay pinned until the request completes.  A request
+// holds its own reference to the file, and the ring page is pinned
+// for as long as it is registered.  aiofree() tears a ring down at exec and exit; a
+// process cannot shrink its memory while requests are in flight.
+//
+// aio.lock protects the request queue, each context's counts, and
+// the completion ring's tail.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "aio.h"
+
+#define NAIOWORKER 4
+
+struct aioctx {
+  struct aioring *ring;  // kernel address of the shared page
+  uint cqtail;           // the kernel's own copy of ring->cqtail
+  int inflight;          // accepted, completion not yet posted
+};
+
+struct aioreq {
+  struct aioctx *ctx;
+  struct file *f;
+  int op;
+  int off;
+  uint va;
+  uint n;
+  uint data;
+  char **pages;          // pinned pages of the buffer, from va's
+  int npages;
+  struct aioreq *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct aioreq *head;
+  struct aioreq *tail;
+  int started;
+  struct proc *worker[NAIOWORKER];
+  struct aioreq *busy[NAIOWORKER];  // request each worker is serving
+} aio;
+
+void
+aioinit(void)
+{
+  initlock(&aio.lock, "aio");
+}
+
+// Post a completion.  Caller must hold aio.lock.
+static void
+aiopost(struct aioctx *ctx, uint data, int res)
+{
+  struct aioring *r = ctx->ring;
+  struct aiocqe *cqe;
+
+  cqe = &r->cq[ctx->cqtail % AIO_NCQ];
+  cqe->data = data;
+  cqe->res = res;
+  __sync_synchronize();   // entry before tail
+  r->cqtail = ++ctx->cqtail;
+  wakeup(ctx);
+}
+
+// Completions posted but not yet consumed, by the kernel's tail
+// and the process's head, which it may have set to anything.
+// Caller must hold aio.lock.
+static int
+aiopending(struct aioctx *ctx)
+{
+  int n = ctx->cqtail - ctx->ring->cqhead;
+
+  if(n < 0)
+    return 0;
+  if(n > AIO_NCQ)
+    return AIO_NCQ;
+  return n;
+}
+
+// Drop the pins on req's first n pages.
+static void
+aiounpin(struct aioreq *req, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    kfree(req->pages[i]);
+  kmfree(req->pages);
+}
+
+// Carry out req a page at a time through its pinned pages.
+// Returns the bytes transferred, or -1 if nothing was.
+static int
+aiodo(struct aioreq *req)
+{
+  uint done, m, va;
+  int r, off;
+  char *kva;
+
+  for(done = 0; done < req->n; done += r){
+    va = req->va + done;
+    kva = req->pages[(va - PGROUNDDOWN(req->va)) / PGSIZE] + va % PGSIZE;
+    m = req->n - done;
+    if(m > PGSIZE - va % PGSIZE)
+      m = PGSIZE - va % PGSIZE;
+    off = req->off < 0 ? -1 : req->off + done;
+    if(req->op == AIO_READ)
+      r = filepread(req->f, kva, m, off);
+    else
+      r = filepwrite(req->f, kva, m, off);
+    if(r < 0)
+      return done ? done : -1;
+    if(r < m)
+      return done + r;
+  }
+  return done;
+}
+
+static void
+aioworker(void *arg)
+{
+  int id = (int)arg;
+  struct aioreq *req;
+  int res;
+
+  acquire(&aio.lock);
+  aio.worker[id] = myproc();
+  release(&aio.lock);
+  for(;;){
+    acquire(&aio.lock);
+    while(aio.head == 0)
+      sleep(&aio.head, &aio.lock);
+    req = aio.head;
+    aio.head = req->next;
+    aio.busy[id] = req;
+    release(&aio.lock);
+
+    res = aiodo(req);
+    fileclose(req->f);
+    aiounpin(req, req->npages);
+
+    acquire(&aio.lock);
+    aio.busy[id] = 0;
+    myproc()->killed = 0;   // aiofree() may have interrupted req
+    aiopost(req->ctx, req->data, res);
+    req->ctx->inflight--;
+    release(&aio.lock);
+    kmfree(req);
+  }
+}
+
+// Register the page at va as the current process's ring.
+int
+aiosetup(uint va)
+{
+  struct proc *curproc = myproc();
+  struct aioctx *ctx;
+  struct aioring *r;
+  int i;
+
+  if(curproc->aio || va % PGSIZE || va >= curproc->sz ||
+     curproc->sz - va < sizeof(struct aioring))
+    return -1;
+  if(prefault(va, sizeof(struct aioring)) < 0)
+    return -1;
+  if((ctx = kmalloc(sizeof(*ctx))) == 0)
+    return -1;
+  if((r = (struct aioring*)uvmpin(curproc->pgdir, va, 1)) == 0){
+    kmfree(ctx);
+    return -1;
+  }
+
+  acquire(&aio.lock);
+  if(!aio.started){
+    for(i = 0; i < NAIOWORKER; i++)
+      if(kthread("aio", aioworker, (void*)i) == 0)
+        panic("aiosetup: kthread");
+    aio.started = 1;
+  }
+  release(&aio.lock);
+
+  r->sqhead = r->sqtail = 0;
+  r->cqhead = r->cqtail = 0;
+  ctx->ring = r;
+  ctx->cqtail = 0;
+  ctx->inflight = 0;
+  curproc->aio = ctx;
+  return 0;
+}
+
+// Check the submission entry e and turn it into a request, with
+// its buffer's pages pinned.  Returns 0 if it is malformed or
+// memory runs out.
+static struct aioreq*
+aioreq(struct aiosqe *e)
+{
+  struct proc *curproc = myproc();
+  struct aioreq *req;
+  struct file *f;
+  uint va;
+  char *p;
+  int i;
+
+  if(e->op != AIO_READ && e->op != AIO_WRITE)
+    return 0;
+  if(e->fd < 0 || e->fd >= NOFILE || (f = curproc->ofile[e->fd]) == 0)
+    return 0;
+  if(e->op == AIO_READ ? !f->readable : !f->writable)
+    return 0;
+  if(e->n > AIO_MAXN || fetchbuf((uint)e->buf, &p, e->n, 0) < 0)
+    return 0;
+  if((req = kmalloc(sizeof(*req))) == 0)
+    return 0;
+  va = PGROUNDDOWN((uint)e->buf);
+  req->npages = (PGROUNDUP((uint)e->buf + e->n) - va) / PGSIZE;
+  if((req->pages = kmalloc(req->npages ? req->npages * sizeof(char*) : 1)) == 0){
+    kmfree(req);
+    return 0;
+  }
+  for(i = 0; i < req->npages; i++, va += PGSIZE){
+    // The kernel writes the pages of a read.
+    if((req->pages[i] = uvmpin(curproc->pgdir, va, e->op == AIO_READ)) == 0){
+      aiounpin(req, i);
+      kmfree(req);
+      return 0;
+    }
+  }
+  req->ctx = curproc->aio;
+  req->f = filedup(f);
+  req->op = e->op;
+  req->off = e->off;
+  req->va = (uint)e->buf;
+  req->n = e->n;
+  req->data = e->data;
+  req->next = 0;
+  return req;
+}
+
+// Submit everything queued on the current process's ring that
+// there is room to complete, then wait until at least minwait
+// completions are ready to reap or nothing is in flight.  Returns
+// the number of entries taken from the submission ring.
+int
+aioenter(int minwait)
+{
+  struct proc *curproc = myproc();
+  struct aioctx *ctx = curproc->aio;
+  struct aioring *r;
+  struct aioreq *req;
+  struct aiosqe e;
+  uint head;
+  int n, room;
+
+  if(ctx == 0)
+    return -1;
+  r = ctx->ring;
+  for(n = 0; (head = r->sqhead) != r->sqtail; n++){
+    if(r->sqtail - head > AIO_NSQ)
+      return -1;
+    // Never accept more than the completion ring can hold, so
+    // that no more than AIO_NCQ requests are ever in flight.
+    acquire(&aio.lock);
+    room = AIO_NCQ - aiopending(ctx) - ctx->inflight;
+    release(&aio.lock);
+    if(room <= 0)
+      break;
+    e = r->sq[head % AIO_NSQ];   // the process may change it
+    r->sqhead = head + 1;
+
+    req = aioreq(&e);
+    acquire(&aio.lock);
+    if(req == 0){
+      aiopost(ctx, e.data, -1);
+    } else {
+      ctx->inflight++;
+      if(aio.head)
+        aio.tail->next = req;
+      else
+        aio.head = req;
+      aio.tail = req;
+      wakeup(&aio.head);
+    }
+    release(&aio.lock);
+  }
+
+  acquire(&aio.lock);
+  while(aiopending(ctx) < minwait && ctx->inflight > 0){
+    if(curproc->killed){
+      release(&aio.lock);
+      return -1;
+    }
+    sleep(ctx, &aio.lock);
+  }
+  release(&aio.lock);
+  return n;
+}
+
+// Does p have requests in flight?
+int
+aiobusy(struct proc *p)
+{
+  return p->aio && p->aio->inflight > 0;
+}
+
+// Tear down p's ring, dropping requests not yet started and
+// waiting for the rest.  Called by p itself at exec and exit.
+void
+aiofree(struct proc *p)
+{
+  struct aioctx *ctx = p->aio;
+  struct aioreq *req, **pp, *dropped;
+  int i;
+
+  if(ctx == 0)
+    return;
+  dropped = 0;
+  acquire(&aio.lock);
+  aio.tail = 0;
+  for(pp = &aio.head; (req = *pp) != 0; ){
+    if(req->ctx == ctx){
+      *pp = req->next;
+      req->next = dropped;
+      dropped = req;
+      ctx->inflight--;
+    } else {
+      aio.tail = req;
+      pp = &req->next;
+    }
+  }
+  // A worker may be blocked for good on a pipe or the console.
+  for(i = 0; i < NAIOWORKER; i++)
+    if(aio.busy[i] && aio.busy[i]->ctx == ctx)
+      kill(aio.worker[i]->pid);
+  while(ctx->inflight > 0)
+    sleep(ctx, &aio.lock);
+  release(&aio.lock);
+
+  while((req = dropped) != 0){
+    dropped = req->next;
+    fileclose(req->f);
+    aiounpin(req, req->npages);
+    kmfree(req);
+  }
+  kfree((char*)ctx->ring);
+  kmfree(ctx);
+  p->aio = 0;
+}
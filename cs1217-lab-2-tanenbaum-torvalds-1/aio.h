@@ -0,0 +1,39 @@
+// Asynchronous I/O rings, shared between a process and the kernel.
+//
+// A process registers one page-aligned struct aioring with
+// aiosetup().  It queues requests by filling sq[sqtail % AIO_NSQ]
+// and advancing sqtail, then hands the whole batch to the kernel
+// with one aioenter() call.  The kernel posts a completion at
+// cq[cqtail % AIO_NCQ] as each request finishes; the process
+// consumes completions up to cqtail and advances cqhead itself,
+// without a system call.
+
+#define AIO_NSQ   32   // submission slots
+#define AIO_NCQ   64   // completion slots
+#define AIO_MAXN  (1000*4096)  // largest request, in bytes
+
+#define AIO_READ  1
+#define AIO_WRITE 2
+
+struct aiosqe {
+  int op;          // AIO_READ or AIO_WRITE
+  int fd;
+  void *buf;
+  uint n;
+  int off;         // file offset, or -1 for the file's own offset
+  uint data;       // passed back in the completion
+};
+
+struct aiocqe {
+  uint data;
+  int res;         // bytes transferred, or -1
+};
+
+struct aioring {
+  volatile uint sqhead;   // advanced by the kernel
+  volatile uint sqtail;   // advanced by the process
+  volatile uint cqhead;   // advanced by the process
+  volatile uint cqtail;   // advanced by the kernel
+  struct aiosqe sq[AIO_NSQ];
+  struct aiocqe cq[AIO_NCQ];
+};
@@ -0,0 +1,206 @@
+// Compare blocking reads with asynchronous ones.
+//
+// usage: aiobench [kbytes [depth [work]]]
+//
+// Writes a file of kbytes, then reads it back a page at a time
+// twice, doing work units of computation per page: first with
+// read(), then through the aio rings with up to depth reads in
+// flight, reaping completions from the shared ring while it
+// computes.  Prints the time each pass took.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "aio.h"
+#include "schedtrace.h"
+
+#define PGSIZE 4096
+#define MAXDEPTH 16
+
+static char file[] = "aiobench.tmp";
+static int mhz;
+static volatile int sink;
+
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+static uint
+us(unsigned long long cycles)
+{
+  uint hi, lo, q, r;
+
+  hi = cycles >> 32;
+  lo = cycles;
+  if(hi >= mhz)
+    return 0xffffffff;
+  asm("divl %4" : "=a"(q), "=d"(r) : "0"(lo), "1"(hi), "rm"(mhz));
+  return q;
+}
+
+static void
+compute(int work)
+{
+  int i;
+
+  for(i = 0; i < work * 10000; i++)
+    sink += i;
+}
+
+// Does page i of the file hold what mkfile() put there?
+static int
+check(char *buf, int i)
+{
+  int j;
+
+  for(j = 0; j < PGSIZE; j++)
+    if(buf[j] != (char)(i + j / 512))
+      return 0;
+  return 1;
+}
+
+static int
+mkfile(int pages, char *buf)
+{
+  int fd, i, j;
+
+  if((fd = open(file, O_CREATE | O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < pages; i++){
+    for(j = 0; j < PGSIZE; j++)
+      buf[j] = i + j / 512;
+    if(write(fd, buf, PGSIZE) != PGSIZE){
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+static int
+blocking(int pages, int work, char *buf)
+{
+  int fd, i, bad;
+
+  if((fd = open(file, O_RDONLY)) < 0)
+    return -1;
+  bad = 0;
+  for(i = 0; i < pages; i++){
+    if(read(fd, buf, PGSIZE) != PGSIZE || !check(buf, i))
+      bad++;
+    compute(work);
+  }
+  close(fd);
+  return bad;
+}
+
+static int
+async(struct aioring *r, int pages, int depth, int work, char *bufs)
+{
+  struct aiosqe *e;
+  struct aiocqe *c;
+  int fd, next, done, inflight, bad, i, slot;
+  int slots[MAXDEPTH], nfree, n;
+
+  if((fd = open(file, O_RDONLY)) < 0)
+    return -1;
+  for(nfree = 0; nfree < depth; nfree++)
+    slots[nfree] = nfree;
+  next = done = inflight = bad = 0;
+  while(done < pages){
+    // Top up the submission ring; one system call per batch.
+    for(n = 0; inflight < depth && next < pages; n++){
+      slot = slots[--nfree];
+      e = &r->sq[r->sqtail % AIO_NSQ];
+      e->op = AIO_READ;
+      e->fd = fd;
+      e->buf = bufs + slot * PGSIZE;
+      e->n = PGSIZE;
+      e->off = next * PGSIZE;
+      e->data = next * MAXDEPTH + slot;
+      r->sqtail++;
+      next++;
+      inflight++;
+    }
+    if(n > 0 && aioenter(0) < 0){
+      printf(2, "aiobench: aioenter failed\n");
+      break;
+    }
+    // Reap whatever is ready without entering the kernel.
+    while(r->cqhead != r->cqtail){
+      c = &r->cq[r->cqhead % AIO_NCQ];
+      i = c->data / MAXDEPTH;
+      slot = c->data % MAXDEPTH;
+      if(c->res != PGSIZE || !check(bufs + slot * PGSIZE, i))
+        bad++;
+      slots[nfree++] = slot;
+      r->cqhead++;
+      inflight--;
+      done++;
+      compute(work);
+    }
+    if(inflight == depth || (next == pages && done < pages))
+      aioenter(1);
+  }
+  close(fd);
+  return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kbytes, depth, work, pages, bad;
+  unsigned long long t0;
+  struct aioring *r;
+  char *mem;
+  uint t;
+
+  kbytes = argc > 1 ? atoi(argv[1]) : 256;
+  depth = argc > 2 ? atoi(argv[2]) : 4;
+  work = argc > 3 ? atoi(argv[3]) : 10;
+  pages = kbytes / 4;
+  if(pages < 1 || depth < 1 || depth > MAXDEPTH || work < 0){
+    printf(2, "usage: aiobench [kbytes [depth [work]]]\n");
+    exit();
+  }
+  if((mhz = schedtrace(TRACE_MHZ, 0, 0)) <= 0)
+    mhz = 1;
+
+  // A page-aligned ring followed by depth buffers.
+  mem = sbrk((2 + depth) * PGSIZE);
+  if(mem == (char*)-1){
+    printf(2, "aiobench: out of memory\n");
+    exit();
+  }
+  r = (struct aioring*)(((uint)mem + PGSIZE - 1) & ~(PGSIZE - 1));
+  if(aiosetup(r) < 0){
+    printf(2, "aiobench: aiosetup failed\n");
+    exit();
+  }
+  if(mkfile(pages, (char*)r + PGSIZE) < 0){
+    printf(2, "aiobench: cannot write %s\n", file);
+    exit();
+  }
+
+  t0 = rdtsc();
+  bad = blocking(pages, work, (char*)r + PGSIZE);
+  t = us(rdtsc() - t0);
+  printf(1, "aiobench: read   %d KB, work %d: %d us, %d bad pages\n",
+         pages * 4, work, t, bad);
+
+  t0 = rdtsc();
+  bad = async(r, pages, depth, work, (char*)r + PGSIZE);
+  t = us(rdtsc() - t0);
+  printf(1, "aiobench: aio    %d KB, work %d, depth %d: %d us, %d bad pages\n",
+         pages * 4, work, depth, t, bad);
+
+  unlink(file);
+  exit();
+}
@@ -5,6 +5,10 @@ struct benchinfo
 {
 	unsigned int childticks;
 	unsigned int children;
+	unsigned int childrtime;	// microseconds reaped children spent running
+	unsigned int childwtime;	// ... runnable, waiting for a CPU
+	unsigned int childstime;	// ... sleeping
+	unsigned int scheduler;		// enum SCHEDULER_TYPE in proc.h
 };
 
 #endif
\ No newline at end of file
@@ -8,10 +8,14 @@
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
+// * To write several, call bwritev: the driver may overlap them.
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
+// * To read a buffer's data while unlocked, call bpin before
+//     brelse and bunpin when done: the block stays cached,
+//     but others may change it meanwhile.
 //
 // The implementation uses two state flags internally:
 // * B_VALID: the buffer data has been read from the disk.
@@ -35,6 +39,8 @@ struct {
   struct buf head;
 } bcache;
 
+struct bdevsw bdevsw[NBDEV];
+
 void
 binit(void)
 {
@@ -92,6 +98,17 @@ bget(uint dev, uint blockno)
   panic("bget: no buffers");
 }
 
+// Hand n locked bufs of one device to its driver.
+static void
+bsync(struct buf **bs, int n)
+{
+  uint dev = bs[0]->dev;
+
+  if(dev >= NBDEV || bdevsw[dev].rw == 0)
+    panic("bsync: no block device");
+  bdevsw[dev].rw(bs, n);
+}
+
 // Return a locked buf with the contents of the indicated block.
 struct buf*
 bread(uint dev, uint blockno)
@@ -100,7 +117,7 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
-    iderw(b);
+    bsync(&b, 1);
   }
   return b;
 }
@@ -112,7 +129,22 @@ bwrite(struct buf *b)
   if(!holdingsleep(&b->lock))
     panic("bwrite");
   b->flags |= B_DIRTY;
-  iderw(b);
+  bsync(&b, 1);
+}
+
+// Write n locked bufs of one device to disk.
+void
+bwritev(struct buf **bs, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(!holdingsleep(&bs[i]->lock) || bs[i]->dev != bs[0]->dev)
+      panic("bwritev");
+    bs[i]->flags |= B_DIRTY;
+  }
+  if(n > 0)
+    bsync(bs, n);
 }
 
 // Release a locked buffer.
@@ -139,6 +171,25 @@ brelse(struct buf *b)
   
   release(&bcache.lock);
 }
+
+// Keep b cached after brelse, until bunpin.
+void
+bpin(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->refcnt++;
+  release(&bcache.lock);
+}
+
+void
+bunpin(struct buf *b)
+{
+  acquire(&bcache.lock);
+  if(b->refcnt == 0)
+    panic("bunpin");
+  b->refcnt--;
+  release(&bcache.lock);
+}
 //PAGEBREAK!
 // Blank page.
 
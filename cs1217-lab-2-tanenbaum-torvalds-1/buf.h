@@ -7,8 +7,19 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  uint qdev;         // disk and block the driver transfers,
+  uint qblockno;     //   after any striping
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
 
+
+// table mapping block device number to driver.  rw syncs n
+// locked bufs of the device with the disk, as bread() and
+// bwrite() describe, and may keep several disks busy at once.
+struct bdevsw {
+  void (*rw)(struct buf**, int);
+};
+
+extern struct bdevsw bdevsw[];
@@ -16,6 +16,7 @@
 #include "x86.h"
 
 static void consputc(int);
+static void cgasync(void);
 
 static int panicked = 0;
 
@@ -98,6 +99,7 @@ cprintf(char *fmt, ...)
       break;
     }
   }
+  cgasync();
 
   if(locking)
     release(&cons.lock);
@@ -111,6 +113,7 @@ panic(char *s)
 
   cli();
   cons.locking = 0;
+  uartflush();     // get out what is queued, then write directly
   // use lapiccpunum so that we can call panic from mycpu()
   cprintf("lapicid %d: panic: ", lapicid());
   cprintf(s);
@@ -118,6 +121,7 @@ panic(char *s)
   getcallerpcs(&s, pcs);
   for(i=0; i<10; i++)
     cprintf(" %p", pcs[i]);
+  cgasync();
   panicked = 1; // freeze other CPU
   for(;;)
     ;
@@ -127,17 +131,24 @@ panic(char *s)
 #define BACKSPACE 0x100
 #define CRTPORT 0x3d4
 static ushort *crt = (ushort*)P2V(0xb8000);  // CGA memory
+static int cgapos = -1;  // cursor position, or -1 if not yet read
 
+// The hardware cursor is read once and then tracked in cgapos;
+// cgasync() moves it after each batch of output rather than
+// after every character, since port I/O is slow.
 static void
 cgaputc(int c)
 {
   int pos;
 
   // Cursor position: col + 80*row.
-  outb(CRTPORT, 14);
-  pos = inb(CRTPORT+1) << 8;
-  outb(CRTPORT, 15);
-  pos |= inb(CRTPORT+1);
+  if(cgapos < 0){
+    outb(CRTPORT, 14);
+    cgapos = inb(CRTPORT+1) << 8;
+    outb(CRTPORT, 15);
+    cgapos |= inb(CRTPORT+1);
+  }
+  pos = cgapos;
 
   if(c == '\n')
     pos += 80 - pos%80;
@@ -155,11 +166,19 @@ cgaputc(int c)
     memset(crt+pos, 0, sizeof(crt[0])*(24*80 - pos));
   }
 
+  cgapos = pos;
+  crt[pos] = ' ' | 0x0700;
+}
+
+static void
+cgasync(void)
+{
+  if(cgapos < 0)
+    return;
   outb(CRTPORT, 14);
-  outb(CRTPORT+1, pos>>8);
+  outb(CRTPORT+1, cgapos>>8);
   outb(CRTPORT, 15);
-  outb(CRTPORT+1, pos);
-  crt[pos] = ' ' | 0x0700;
+  outb(CRTPORT+1, cgapos);
 }
 
 void
@@ -226,6 +245,7 @@ consoleintr(int (*getc)(void))
       break;
     }
   }
+  cgasync();
   release(&cons.lock);
   if(doprocdump) {
     procdump();  // now call procdump() wo. cons.lock held
@@ -279,6 +299,7 @@ consolewrite(struct inode *ip, char *buf, int n)
   acquire(&cons.lock);
   for(i = 0; i < n; i++)
     consputc(buf[i] & 0xff);
+  cgasync();
   release(&cons.lock);
   ilock(ip);
 
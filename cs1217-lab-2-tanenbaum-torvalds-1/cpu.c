@@ -46,6 +46,8 @@ int main() {
     if (benchinfo(&b) < 0) exit();
 
     printf(1, "children: %d, child ticks: %d\n", b.children, b.childticks);
+    printf(1, "child run: %d ms, wait: %d ms, sleep: %d ms\n",
+           b.childrtime / 1000, b.childwtime / 1000, b.childstime / 1000);
 
     exit();
 }
@@ -0,0 +1,21 @@
+#ifndef _CURRENCY_H_
+#define _CURRENCY_H_
+
+// Lottery ticket currencies, managed with tickctl(op, a, b).
+//
+// Every process holds its tickets in some currency; currency 0 is
+// the base.  Any other currency is funded with tickets of its
+// parent, and that funding is shared among whichever of its own
+// tickets belong to runnable processes.  So a group of processes
+// in one currency gets the same share of the CPU however many of
+// them there are.  fork() gives the child its parent's currency
+// and tickets.
+
+#define NCURRENCY   16
+
+#define TC_CREATE   0   // new currency funded with b tickets of a; returns its id
+#define TC_JOIN     1   // hold b tickets of currency a
+#define TC_FUND     2   // fund currency a with b tickets of its parent
+#define TC_DESTROY  3   // remove currency a, which nothing may use
+
+#endif // _CURRENCY_H_
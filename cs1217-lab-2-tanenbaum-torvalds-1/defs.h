@@ -1,22 +1,36 @@
 struct pstat;
 struct benchinfo;
+struct traceevent;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
 struct pipe;
+struct profsample;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct trapframe;
+
+// aio.c
+int             aiobusy(struct proc*);
+int             aioenter(int);
+void            aiofree(struct proc*);
+void            aioinit(void);
+int             aiosetup(uint);
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
 
 // console.c
 void            consoleinit(void);
@@ -26,6 +40,8 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+int             loadfault(uint);
+int             prefault(uint, uint);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,32 +49,43 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, char*, int, int);
+int             filepwrite(struct file*, char*, int, int);
+int             filesend(struct file*, struct file*, int);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int);
 
 // fs.c
+void            bclear(int, uint);
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
-struct inode*   dirlookup(struct inode*, char*, uint*);
+struct inode*   dirlookup(struct inode*, char*, uint*, int*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+int             ismount(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            itext(struct inode*, int);
 void            iupdate(struct inode*);
+int             mount(struct inode*);
+void            mountinit(void);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+struct buf*     readiblock(struct inode*, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
 // ide.c
 void            ideinit(void);
-void            ideintr(void);
-void            iderw(struct buf*);
+void            ideintr(int);
+void            iderw(struct buf**, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -67,9 +94,14 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloczero(void);
+char*           kalloclarge(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kref(char*);
+int             krefs(char*);
+int             kzero(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -78,14 +110,19 @@ void            kbdintr(void);
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
+uint            lapiccount(void);
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapiconeshot(uint);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+int             log_deferfree(uint);
+int             log_ordered(void);
+extern int      logordered;
 void            begin_op();
 void            end_op();
 
@@ -97,6 +134,11 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+char*           pcacheget(struct inode*, uint, uint);
+void            pcacheinit(void);
+void            pcacheinval(struct inode*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -110,15 +152,19 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+struct proc*    kthread(char*, void (*)(void*), void*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
-void            scheduler(void) __attribute__((noreturn));
-void            scheduler_mlfq(void) __attribute__((noreturn));
-void            scheduler_lottery(void) __attribute__((noreturn));
+void            scheduler(void);
+void            scheduler_mlfq(void);
+void            scheduler_lottery(void);
 void            sched(void);
+void            setmaxprio(int);
 void            setproc(struct proc*);
+void            setscheduler(int);
+void            setseed(int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
@@ -127,8 +173,21 @@ void            yield(void);
 int             setpriority(int, int);
 int             getpriority(int);
 int				settickets(int);
-int				getpinfo(struct pstat*);
+int             tickctl(int, int, int);
+int				getpinfo(struct pstat*, int);
 int				benchinfo(struct benchinfo*);
+int             setdeadline(uint, uint);
+void            inheritblock(struct sleeplock*);
+void            inheritdrop(struct sleeplock*);
+void            inherithold(struct sleeplock*);
+int             edfpreempt(void);
+extern int      autotune;
+extern int      boostticks;
+extern int      maxprio;
+extern int      maxproc;
+extern int      mlfqbudget;
+extern int      randseed;
+extern int      resptarget;
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -142,6 +201,11 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// slab.c
+void*           kmalloc(uint);
+void            kmfree(void*);
+void            slabinit(void);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -157,16 +221,47 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// prof.c
+extern volatile int profiling;
+int             profctl(int, uint, int);
+void            profinit(void);
+void            profintr(struct trapframe*);
+
+// sysctl.c
+int             sysctl(int, int*, int*);
+
 // syscall.c
 int             argint(int, int*);
-int             argptr(int, char**, int);
+int             argptr(int, char**, int, int);
 int             argstr(int, char**);
+int             fetchbuf(uint, char**, int, int);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
+// trace.c
+int             schedtrace(int, uint, int);
+void            trace(int, int, int);
+void            traceinit(void);
+
 // timer.c
+extern uint     quantumus;
+extern uint     tscmhz;
+int             nanosleep(uint, uint);
+uint64          tsc2us(uint64);
+int             timerexpired(void);
 void            timerinit(void);
+void            timerintr(void);
+void            timerslice(uint64);
+
+// tmpfs.c
+uint            tmpialloc(short);
+void            tmpinit(void);
+void            tmpiread(struct inode*);
+void            tmpiupdate(struct inode*);
+int             tmpread(struct inode*, char*, uint, uint);
+void            tmptrunc(struct inode*);
+int             tmpwrite(struct inode*, char*, uint, uint);
 
 // trap.c
 void            idtinit(void);
@@ -175,6 +270,7 @@ void            tvinit(void);
 extern struct spinlock tickslock;
 
 // uart.c
+void            uartflush(void);
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
@@ -188,12 +284,18 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             mapuvm(pde_t*, char*, struct inode*, uint, uint, int);
+int             cowfault(pde_t*, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             copyin(pde_t*, void*, uint, uint);
+char*           uvmpin(pde_t*, uint, int);
+int             uvmwritable(pde_t*, uint, uint);
+int             uvmsink(pde_t*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+extern int      largepages;
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,124 @@
+// Check that an EDF task meets its deadlines under background load.
+//
+// usage: edftest [period_us [runtime_us [periods [hogs]]]]
+//
+// Starts hogs CPU-bound background processes, then runs a periodic
+// task that does half of runtime_us of work every period_us and
+// counts the periods in which it finished late.  With runtime_us 0
+// the task runs without a reservation, for comparison.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "schedtrace.h"
+
+#define MAXHOGS 16
+
+static int mhz;
+static volatile int sink;
+
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// Microseconds in cycles, which must be under 2^32 * mhz.
+static uint
+us(unsigned long long cycles)
+{
+  uint hi, lo, q, r;
+
+  hi = cycles >> 32;
+  lo = cycles;
+  if(hi >= mhz)
+    return 0xffffffff;
+  asm("divl %4" : "=a"(q), "=d"(r) : "0"(lo), "1"(hi), "rm"(mhz));
+  return q;
+}
+
+static void
+spin(uint n)
+{
+  uint i;
+
+  for(i = 0; i < n; i++)
+    sink += i;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int period, runtime, periods, hogs;
+  int i, missed, pid[MAXHOGS];
+  uint loops, late, left, worst, work;
+  unsigned long long t0, start, end, now;
+
+  period = argc > 1 ? atoi(argv[1]) : 10000;
+  runtime = argc > 2 ? atoi(argv[2]) : 2000;
+  periods = argc > 3 ? atoi(argv[3]) : 200;
+  hogs = argc > 4 ? atoi(argv[4]) : 4;
+  if(period < 1 || runtime < 0 || runtime > period || periods < 1 ||
+     hogs < 0 || hogs > MAXHOGS){
+    printf(2, "usage: edftest [period_us [runtime_us [periods [hogs]]]]\n");
+    exit();
+  }
+  if((mhz = schedtrace(TRACE_MHZ, 0, 0)) <= 0){
+    printf(2, "edftest: cannot read the TSC rate\n");
+    exit();
+  }
+
+  // Calibrate the work loop while the machine is quiet.
+  t0 = rdtsc();
+  spin(1000000);
+  loops = 1000000 / (us(rdtsc() - t0) + 1);
+  work = (runtime ? runtime : period / 5) / 2;
+
+  for(i = 0; i < hogs; i++){
+    if((pid[i] = fork()) == 0)
+      for(;;)
+        spin(1000000);
+  }
+
+  if(runtime && setdeadline(period, runtime) < 0){
+    printf(2, "edftest: reservation rejected\n");
+    periods = 0;
+  }
+
+  missed = 0;
+  worst = 0;
+  t0 = rdtsc();
+  for(i = 0; i < periods; i++){
+    start = t0 + (unsigned long long)i * period * mhz;
+    spin(work * loops);
+    end = rdtsc();
+    if(end > start + (unsigned long long)period * mhz){
+      missed++;
+      late = us(end - start) - period;
+      if(late > worst)
+        worst = late;
+    }
+    now = rdtsc();
+    start += (unsigned long long)period * mhz;
+    if(now < start){
+      left = us(start - now);
+      nanosleep(left / 1000000, (left % 1000000) * 1000);
+    }
+  }
+  setdeadline(0, 0);
+
+  for(i = 0; i < hogs; i++)
+    if(pid[i] > 0)
+      kill(pid[i]);
+  for(i = 0; i < hogs; i++)
+    wait();
+
+  printf(1, "edftest: period %d us, %s %d us, %d hogs: "
+         "%d of %d deadlines missed, worst lateness %d us\n",
+         period, runtime ? "runtime" : "no reservation, work",
+         runtime ? runtime : work, hogs, missed, periods, worst);
+  exit();
+}
@@ -7,15 +7,23 @@
 #include "x86.h"
 #include "elf.h"
 
+// exec() does not read the program's segments; it records them
+// in the process and leaves their pages unmapped, and loadfault()
+// maps each page from the page cache when it is first touched.
+// So starting a large program costs only the pages it uses.  The
+// file may not be written while the program runs (see itext()),
+// so pages loaded late match those loaded early.
+
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe, *oldexe;
   struct proghdr ph;
+  struct seg seg[NSEG];
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
 
@@ -28,6 +36,7 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,8 +47,9 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.
   sz = 0;
+  nseg = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -47,17 +57,29 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr < sz || ph.off + ph.filesz < ph.off || nseg == NSEG)
+      goto bad;
+    // Back any gap since the previous segment with zeroed pages.
+    if(ph.vaddr > PGROUNDUP(sz) && allocuvm(pgdir, sz, ph.vaddr) == 0)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].writable = (ph.flags & ELF_PROG_FLAG_WRITE) != 0;
+    nseg++;
+    sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // Keep a reference to the program for loadfault(), and keep
+  // it from being written while this process runs it.
+  itext(ip, 1);
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
   // Allocate two pages at the next page boundary.
@@ -94,13 +116,24 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  aiofree(curproc);
   oldpgdir = curproc->pgdir;
+  oldexe = curproc->exe;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->exe = exe;
+  curproc->nseg = nseg;
+  memmove(curproc->seg, seg, sizeof(seg));
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
   freevm(oldpgdir);
+  if(oldexe){
+    itext(oldexe, -1);
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
   return 0;
 
  bad:
@@ -110,5 +143,62 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    itext(exe, -1);
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
+
+// Map the not-yet-loaded program page containing va into the
+// current process: file contents come from the page cache, and
+// pages past the end of the file part of a segment are zeroed.
+// Returns -1 if va is not in an unloaded segment page.
+int
+loadfault(uint va)
+{
+  struct proc *curproc = myproc();
+  struct seg *s;
+  uint o;
+  int r;
+
+  va = PGROUNDDOWN(va);
+  if(va >= curproc->sz || curproc->exe == 0)
+    return -1;
+  for(s = curproc->seg; s < &curproc->seg[curproc->nseg]; s++)
+    if(va >= s->va && va - s->va < s->memsz)
+      break;
+  if(s == &curproc->seg[curproc->nseg])
+    return -1;
+  if(uva2ka(curproc->pgdir, (char*)va) != 0)
+    return -1;   // already loaded
+
+  o = va - s->va;
+  if(o < s->filesz){
+    ilock(curproc->exe);
+    r = mapuvm(curproc->pgdir, (char*)va, curproc->exe, s->off + o,
+               s->filesz - o < PGSIZE ? s->filesz - o : PGSIZE, s->writable);
+    iunlock(curproc->exe);
+    return r;
+  }
+  return allocuvm(curproc->pgdir, va, va + PGSIZE) ? 0 : -1;
+}
+
+// Load any unloaded program pages in [addr, addr+n) of the current
+// process, so the kernel can use that memory without faulting.
+// Caller must have checked that the range lies below sz.
+int
+prefault(uint addr, uint n)
+{
+  struct proc *curproc = myproc();
+  uint va;
+
+  if(n == 0 || curproc->nseg == 0)
+    return 0;
+  for(va = PGROUNDDOWN(addr); va < addr + n; va += PGSIZE)
+    if(uva2ka(curproc->pgdir, (char*)va) == 0 && loadfault(va) < 0)
+      return -1;
+  return 0;
+}
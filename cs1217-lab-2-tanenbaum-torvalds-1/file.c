@@ -9,11 +9,20 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "buf.h"
+#include "stat.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
+
+#define ORDEREDMAX (64*BSIZE)   // see writemax()
+
+// Files are allocated from the slab allocator on demand and freed
+// when their last reference goes away; ftable.lock protects the
+// reference counts.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  int nfile;  // number of allocated files
 } ftable;
 
 void
@@ -28,16 +37,15 @@ filealloc(void)
 {
   struct file *f;
 
+  if((f = kmalloc(sizeof(*f))) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -66,9 +74,9 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmfree(f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -112,7 +120,76 @@ fileread(struct file *f, char *addr, int n)
   panic("fileread");
 }
 
+// Read from file f at offset off, or at the file's own offset
+// if off is negative, which is left alone otherwise.
+int
+filepread(struct file *f, char *addr, int n, int off)
+{
+  int r;
+
+  if(off < 0 || f->type != FD_INODE)
+    return fileread(f, addr, n);
+  if(f->readable == 0)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Read from file f into n buffers, stopping at the first
+// short read.
+int
+filereadv(struct file *f, struct iovec *iov, int n)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_INODE){
+    // One lock for all the buffers.
+    ilock(f->ip);
+    tot = 0;
+    for(i = 0; i < n; i++){
+      if((r = readi(f->ip, iov[i].iov_base, f->off, iov[i].iov_len)) < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      f->off += r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    iunlock(f->ip);
+    return tot;
+  }
+  tot = 0;
+  for(i = 0; i < n; i++){
+    if((r = fileread(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
+
 //PAGEBREAK!
+// Most bytes one transaction may write to a file.  A journaled
+// transaction must fit the data blocks in MAXOPBLOCKS, along with
+// the i-node, indirect block, allocation blocks, and 2 blocks of
+// slop for non-aligned writes.  An ordered one logs only the
+// i-node, indirect and allocation blocks, however much it writes.
+// Call between begin_op() and end_op().
+static int
+writemax(void)
+{
+  if(log_ordered())
+    return ORDEREDMAX;
+  return ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+}
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
@@ -125,19 +202,16 @@ filewrite(struct file *f, char *addr, int n)
     return pipewrite(f->pipe, addr, n);
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
+    // the maximum log transaction size; see writemax().
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
     int i = 0;
     while(i < n){
+      begin_op();
       int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+      if(n1 > writemax())
+        n1 = writemax();
 
-      begin_op();
       ilock(f->ip);
       if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
         f->off += r;
@@ -155,3 +229,95 @@ filewrite(struct file *f, char *addr, int n)
   panic("filewrite");
 }
 
+// Write to file f at offset off, or at the file's own offset
+// if off is negative, which is left alone otherwise.
+int
+filepwrite(struct file *f, char *addr, int n, int off)
+{
+  int r, i, n1;
+
+  if(off < 0 || f->type != FD_INODE)
+    return filewrite(f, addr, n);
+  if(f->writable == 0)
+    return -1;
+  // a few blocks at a time, as in filewrite().
+  for(i = 0; i < n; i += r){
+    begin_op();
+    n1 = n - i;
+    if(n1 > writemax())
+      n1 = writemax();
+    ilock(f->ip);
+    r = writei(f->ip, addr + i, off + i, n1);
+    iunlock(f->ip);
+    end_op();
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filepwrite");
+  }
+  return i == n ? n : -1;
+}
+
+// Write n buffers to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int n)
+{
+  int i, r, tot;
+
+  tot = 0;
+  for(i = 0; i < n; i++){
+    if((r = filewrite(f, iov[i].iov_base, iov[i].iov_len)) < 0)
+      return tot ? tot : -1;
+    tot += r;
+  }
+  return tot;
+}
+
+// Copy up to n bytes from the current offset of in, which must be
+// a plain file, to out, a file, pipe or device.  The data goes
+// straight from the buffer cache to out: each block is pinned
+// rather than locked while it is written, so a reader of out that
+// needs the same block cannot deadlock with us.
+int
+filesend(struct file *out, struct file *in, int n)
+{
+  struct buf *bp;
+  uint off, m;
+  int r, tot;
+
+  if(in->readable == 0 || out->writable == 0 || in->type != FD_INODE)
+    return -1;
+  for(tot = 0; tot < n; tot += r){
+    ilock(in->ip);
+    if(in->ip->type == T_DEV || in->ip->dev == TMPDEV){
+      iunlock(in->ip);
+      return -1;   // no buffer to send from
+    }
+    off = in->off;
+    if(off >= in->ip->size){
+      iunlock(in->ip);
+      break;
+    }
+    m = BSIZE - off%BSIZE;
+    if(m > n - tot)
+      m = n - tot;
+    if(m > in->ip->size - off)
+      m = in->ip->size - off;
+    bp = readiblock(in->ip, off);
+    bpin(bp);
+    brelse(bp);
+    iunlock(in->ip);
+
+    r = filewrite(out, (char*)bp->data + off%BSIZE, m);
+    bunpin(bp);
+    if(r < 0)
+      return tot ? tot : -1;
+    in->off = off + r;
+    if(r < m){
+      tot += r;
+      break;
+    }
+  }
+  return tot;
+}
+
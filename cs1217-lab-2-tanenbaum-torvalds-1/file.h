@@ -14,6 +14,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // icache hash chain, protected by icache.lock
+  struct inode *lrunext; // icache idle list while ref is 0, likewise
+  struct inode *lruprev;
+  int ntext;          // processes running it, protected by icache.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -52,9 +52,10 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a disk block, zeroed unless the caller is about to
+// overwrite it outside the log (see log_ordered()).
 static uint
-balloc(uint dev)
+balloc(uint dev, int zero)
 {
   int b, bi, m;
   struct buf *bp;
@@ -68,7 +69,8 @@ balloc(uint dev)
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        if(zero)
+          bzero(dev, b + bi);
         return b + bi;
       }
     }
@@ -77,9 +79,9 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
-// Free a disk block.
-static void
-bfree(int dev, uint b)
+// Free a disk block now.
+void
+bclear(int dev, uint b)
 {
   struct buf *bp;
   int bi, m;
@@ -94,6 +96,17 @@ bfree(int dev, uint b)
   brelse(bp);
 }
 
+// Free a disk block, or have the log free it at commit, so
+// that it cannot be reallocated and overwritten in place while
+// the transaction freeing it is still open.
+static void
+bfree(int dev, uint b)
+{
+  if(log_deferfree(b))
+    return;
+  bclear(dev, b);
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -162,21 +175,77 @@ bfree(int dev, uint b)
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+//
+// Cache entries are allocated with kmalloc() when iget() first
+// needs them, so the number of active inodes is limited only by
+// memory.  Entries are kept in a hash table on (dev, inum) so
+// that iget() need not scan them all.  When iput() drops the
+// last reference to a valid inode, the entry stays in the hash
+// on an idle list, least recently used first, so that looking
+// the same path up again need not reread the inode.  The oldest
+// idle entries are freed when there are more than NIDLE, or
+// when kmalloc() runs out of memory for a new one.
+
+#define NIHASH 61
+#define NIDLE  200
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode *idle;       // least recently used idle entry
+  struct inode *idletail;
+  int nidle;
 } icache;
 
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIHASH)
+
+// Take ip off the idle list.  Caller must hold icache.lock.
+static void
+idleunlink(struct inode *ip)
+{
+  if(ip->lruprev)
+    ip->lruprev->lrunext = ip->lrunext;
+  else
+    icache.idle = ip->lrunext;
+  if(ip->lrunext)
+    ip->lrunext->lruprev = ip->lruprev;
+  else
+    icache.idletail = ip->lruprev;
+  ip->lrunext = ip->lruprev = 0;
+  icache.nidle--;
+}
+
+// Take ip out of the cache.  Caller must hold icache.lock, and
+// ip must be unreferenced and off the idle list.
+static void
+iunhash(struct inode *ip)
+{
+  struct inode **pp;
+
+  for(pp = &icache.hash[IHASH(ip->dev, ip->inum)]; *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+}
+
+// Free the least recently used idle entry.  Returns 0 if there
+// are none.  Caller must hold icache.lock.
+static int
+ievict(void)
+{
+  struct inode *ip;
+
+  if((ip = icache.idle) == 0)
+    return 0;
+  idleunlink(ip);
+  iunhash(ip);
+  kmfree(ip);
+  return 1;
+}
+
 void
 iinit(int dev)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
@@ -190,23 +259,34 @@ static struct inode* iget(uint dev, uint inum);
 //PAGEBREAK!
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
+// Returns an unlocked but allocated and referenced inode,
+// or 0 if out of memory.
 struct inode*
 ialloc(uint dev, short type)
 {
   int inum;
   struct buf *bp;
   struct dinode *dip;
+  struct inode *ip;
 
+  if(dev == TMPDEV){
+    if((inum = tmpialloc(type)) == 0)
+      return 0;
+    return iget(dev, inum);
+  }
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
+      if((ip = iget(dev, inum)) == 0){
+        brelse(bp);
+        return 0;
+      }
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      return ip;
     }
     brelse(bp);
   }
@@ -223,6 +303,10 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
+  if(ip->dev == TMPDEV){
+    tmpiupdate(ip);
+    return;
+  }
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
@@ -238,34 +322,56 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+// Returns 0 if out of memory.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, *nip;
+  uint h;
 
+  h = IHASH(dev, inum);
+  nip = 0;
   acquire(&icache.lock);
+  for(;;){
+    // Is the inode already cached?
+    for(ip = icache.hash[h]; ip; ip = ip->hnext){
+      if(ip->dev == dev && ip->inum == inum){
+        if(ip->ref++ == 0)
+          idleunlink(ip);
+        release(&icache.lock);
+        if(nip)
+          kmfree(nip);
+        return ip;
+      }
+    }
+    if(nip)
+      break;
 
-  // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+    // Allocate a new entry without holding the lock, then
+    // look again in case another process cached it meanwhile.
+    release(&icache.lock);
+    if((nip = kmalloc(sizeof(*nip))) == 0){
+      // Make room by dropping idle entries, and try again.
+      acquire(&icache.lock);
+      if(!ievict()){
+        release(&icache.lock);
+        return 0;
+      }
       release(&icache.lock);
-      return ip;
+      continue;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    memset(nip, 0, sizeof(*nip));
+    initsleeplock(&nip->lock, "inode");
+    acquire(&icache.lock);
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  ip = nip;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = icache.hash[h];
+  icache.hash[h] = ip;
   release(&icache.lock);
 
   return ip;
@@ -296,15 +402,19 @@ ilock(struct inode *ip)
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-    dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
-    ip->major = dip->major;
-    ip->minor = dip->minor;
-    ip->nlink = dip->nlink;
-    ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-    brelse(bp);
+    if(ip->dev == TMPDEV)
+      tmpiread(ip);
+    else {
+      bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+      dip = (struct dinode*)bp->data + ip->inum%IPB;
+      ip->type = dip->type;
+      ip->major = dip->major;
+      ip->minor = dip->minor;
+      ip->nlink = dip->nlink;
+      ip->size = dip->size;
+      memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+      brelse(bp);
+    }
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -322,8 +432,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry goes
+// on the idle list, or is freed if the inode is no longer valid.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -347,7 +457,43 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref > 0){
+    release(&icache.lock);
+    return;
+  }
+  // Last reference.  Keep a valid inode cached, as the most
+  // recently used idle entry.
+  if(!ip->valid){
+    iunhash(ip);
+    release(&icache.lock);
+    kmfree(ip);
+    return;
+  }
+  ip->lrunext = 0;
+  ip->lruprev = icache.idletail;
+  if(icache.idletail)
+    icache.idletail->lrunext = ip;
+  else
+    icache.idle = ip;
+  icache.idletail = ip;
+  if(++icache.nidle > NIDLE)
+    ievict();
+  release(&icache.lock);
+}
+
+// Count ip as the program of one more (n = 1) or one fewer
+// (n = -1) running process.  loadfault() reads program pages
+// from the file long after exec(), so writei() refuses to change
+// a file while any process is running it.  exec() must hold
+// ip->lock when it adds the first count, so that no write is
+// under way.
+void
+itext(struct inode *ip, int n)
+{
+  acquire(&icache.lock);
+  ip->ntext += n;
+  if(ip->ntext < 0)
+    panic("itext");
   release(&icache.lock);
 }
 
@@ -374,10 +520,15 @@ bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
+  int zero;
+
+  // File data written outside the log needs no zeroing: writei
+  // overwrites it, and nothing past ip->size is ever read.
+  zero = !(ip->type == T_FILE && log_ordered());
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->dev, zero);
     return addr;
   }
   bn -= NDIRECT;
@@ -385,11 +536,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, 1);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = balloc(ip->dev, zero);
       log_write(bp);
     }
     brelse(bp);
@@ -411,6 +562,11 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  pcacheinval(ip);
+  if(ip->dev == TMPDEV){
+    tmptrunc(ip);
+    return;
+  }
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -465,6 +621,8 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     return -1;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->dev == TMPDEV)
+    return tmpread(ip, dst, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -475,6 +633,17 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   return n;
 }
 
+// Return the locked buffer holding the byte at off in ip, for
+// callers that want to use the data in place.  Caller must hold
+// ip->lock, and off must be within the file.
+struct buf*
+readiblock(struct inode *ip, uint off)
+{
+  if(ip->type == T_DEV || ip->dev == TMPDEV || off >= ip->size)
+    panic("readiblock");
+  return bread(ip->dev, bmap(ip, off/BSIZE));
+}
+
 // PAGEBREAK!
 // Write data to inode.
 // Caller must hold ip->lock.
@@ -490,8 +659,13 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
+  if(ip->ntext > 0)
+    return -1;    // a running program; see itext()
   if(off > ip->size || off + n < off)
     return -1;
+  pcacheinval(ip);
+  if(ip->dev == TMPDEV)
+    return tmpwrite(ip, src, off, n);
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
@@ -499,7 +673,10 @@ writei(struct inode *ip, char *src, uint off, uint n)
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
-    log_write(bp);
+    if(ip->type == T_FILE && log_ordered())
+      bwrite(bp);   // in place, before the commit record
+    else
+      log_write(bp);
     brelse(bp);
   }
 
@@ -520,11 +697,12 @@ namecmp(const char *s, const char *t)
 }
 
 // Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+// If found, set *poff to byte offset of entry and return its
+// inode number; otherwise return 0.
+static uint
+dirfind(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off;
   struct dirent de;
 
   if(dp->type != T_DIR)
@@ -539,27 +717,42 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       // entry matches path element
       if(poff)
         *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+      return de.inum;
     }
   }
 
   return 0;
 }
 
+// Look for a directory entry in a directory and return its inode.
+// If found, set *poff to byte offset of entry.  Returns 0 if there
+// is no such entry, or if there is no memory for the inode, in
+// which case *nomem (if nomem is not 0) is set to tell them apart.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff, int *nomem)
+{
+  struct inode *ip;
+  uint inum;
+
+  if(nomem)
+    *nomem = 0;
+  if((inum = dirfind(dp, name, poff)) == 0)
+    return 0;
+  if((ip = iget(dp->dev, inum)) == 0 && nomem)
+    *nomem = 1;
+  return ip;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
-  struct inode *ip;
 
   // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  if(dirfind(dp, name, 0) != 0)
     return -1;
-  }
 
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
@@ -617,6 +810,100 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Mount table: directories covered by the root of another file
+// system.  Only tmpfs can be mounted, and only once.
+static struct {
+  struct spinlock lock;
+  struct {
+    struct inode *on;     // covered directory
+    struct inode *root;   // root of the file system on it
+  } m[NMOUNT];
+} mtab;
+
+void
+mountinit(void)
+{
+  initlock(&mtab.lock, "mtab");
+}
+
+// Mount tmpfs on directory ip, keeping the reference to ip.
+// Caller must not hold ip->lock.
+int
+mount(struct inode *ip)
+{
+  struct inode *root;
+  int i, slot;
+
+  if(ip->dev == TMPDEV || ip->inum == ROOTINO)
+    return -1;
+  acquire(&mtab.lock);
+  slot = -1;
+  for(i = 0; i < NMOUNT; i++){
+    if(mtab.m[i].on == 0)
+      slot = i;
+    else if(mtab.m[i].root->dev == TMPDEV)
+      break;      // already mounted
+  }
+  if(i < NMOUNT || slot < 0){
+    release(&mtab.lock);
+    return -1;
+  }
+  if((root = iget(TMPDEV, ROOTINO)) == 0){
+    release(&mtab.lock);
+    return -1;
+  }
+  mtab.m[slot].on = ip;
+  mtab.m[slot].root = root;
+  release(&mtab.lock);
+
+  ilock(root);
+  if(root->size == 0 &&
+     (dirlink(root, ".", ROOTINO) < 0 || dirlink(root, "..", ROOTINO) < 0))
+    panic("mount: dots");
+  iunlock(root);
+  return 0;
+}
+
+// Is something mounted on ip?
+int
+ismount(struct inode *ip)
+{
+  int i, r;
+
+  r = 0;
+  acquire(&mtab.lock);
+  for(i = 0; i < NMOUNT; i++)
+    if(mtab.m[i].on == ip)
+      r = 1;
+  release(&mtab.lock);
+  return r;
+}
+
+// If ip is covered by a mount, swap it for the mounted root.
+// With up set, swap a mounted root for the directory it covers,
+// for looking up "..".
+static struct inode*
+mountcross(struct inode *ip, int up)
+{
+  struct inode *next;
+  int i;
+
+  next = 0;
+  acquire(&mtab.lock);
+  for(i = 0; i < NMOUNT; i++){
+    if(mtab.m[i].on == 0)
+      continue;
+    if(up ? mtab.m[i].root == ip : mtab.m[i].on == ip)
+      next = up ? mtab.m[i].on : mtab.m[i].root;
+  }
+  release(&mtab.lock);
+  if(next == 0)
+    return ip;
+  next = idup(next);
+  iput(ip);
+  return next;
+}
+
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
@@ -626,12 +913,15 @@ namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
-  if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
-  else
+  if(*path == '/'){
+    if((ip = iget(ROOTDEV, ROOTINO)) == 0)
+      return 0;
+  } else
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    if(namecmp(name, "..") == 0)
+      ip = mountcross(ip, 1);
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -642,12 +932,12 @@ namex(char *path, int nameiparent, char *name)
       iunlock(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
+    if((next = dirlookup(ip, name, 0, 0)) == 0){
       iunlockput(ip);
       return 0;
     }
     iunlockput(ip);
-    ip = next;
+    ip = mountcross(next, 0);
   }
   if(nameiparent){
     iput(ip);
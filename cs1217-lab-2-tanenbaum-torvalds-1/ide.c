@@ -1,4 +1,14 @@
 // Simple PIO-based (non-DMA) IDE driver code.
+//
+// Disk n is drive n&1 on channel n/2: disks 0 and 1 are the
+// primary master and slave, 2 and 3 the secondary ones.  Each
+// channel has its own queue and interrupt, so both channels can
+// be transferring at once.
+//
+// Block device RAIDDEV stripes blocks round-robin over the disks
+// in stripe[], one on each channel (RAID-0): block b is block
+// b/NSTRIPE of disk stripe[b%NSTRIPE].  A run of consecutive
+// blocks handed to iderw() together keeps both channels busy.
 
 #include "types.h"
 #include "defs.h"
@@ -24,23 +34,32 @@
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+#define NCHAN 2
+#define NDISK (2*NCHAN)
 
-static struct spinlock idelock;
-static struct buf *idequeue;
+// queue points to the buf now being read/written to the disk.
+// queue->qnext points to the next buf to be processed.
+// You must hold the channel's lock while manipulating queue.
+struct idechan {
+  struct spinlock lock;
+  struct buf *queue;
+  int base;             // command block registers
+  int ctl;              // device control register
+};
+
+static struct idechan chan[NCHAN];
+static int havedisk[NDISK];
+static int stripe[NSTRIPE] = { 1, 2 };
 
-static int havedisk1;
 static void idestart(struct buf*);
 
 // Wait for IDE disk to become ready.
 static int
-idewait(int checkerr)
+idewait(struct idechan *c, int checkerr)
 {
   int r;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
+  while(((r = inb(c->base+7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
     ;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
@@ -50,73 +69,103 @@ idewait(int checkerr)
 void
 ideinit(void)
 {
-  int i;
-
-  initlock(&idelock, "ide");
+  struct idechan *c;
+  int i, n, r;
+
+  chan[0].base = 0x1f0;
+  chan[0].ctl = 0x3f6;
+  chan[1].base = 0x170;
+  chan[1].ctl = 0x376;
+  for(i = 0; i < NCHAN; i++)
+    initlock(&chan[i].lock, "ide");
   ioapicenable(IRQ_IDE, ncpu - 1);
-  idewait(0);
-
-  // Check if disk 1 is present
-  outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
-    if(inb(0x1f7) != 0){
-      havedisk1 = 1;
-      break;
+  idewait(&chan[0], 0);
+
+  // Disk 0 holds the kernel.  Check which others are present;
+  // an empty channel reads as all zeros or all ones.
+  havedisk[0] = 1;
+  for(n = 1; n < NDISK; n++){
+    c = &chan[n/2];
+    outb(c->base+6, 0xe0 | ((n&1)<<4));
+    for(i=0; i<1000; i++){
+      r = inb(c->base+7);
+      if(r != 0 && r != 0xff){
+        havedisk[n] = 1;
+        break;
+      }
     }
   }
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+  if(havedisk[2] || havedisk[3]){
+    ioapicenable(IRQ_IDE+1, ncpu - 1);
+    outb(chan[1].base+6, 0xe0 | ((havedisk[2] ? 0 : 1)<<4));
+    idewait(&chan[1], 0);
+  }
+
+  for(n = 0; n < NDISK; n++)
+    if(havedisk[n])
+      bdevsw[n].rw = iderw;
+  for(n = 0; n < NSTRIPE; n++)
+    if(!havedisk[stripe[n]])
+      break;
+  if(n == NSTRIPE)
+    bdevsw[RAIDDEV].rw = iderw;
+  else if(ROOTDEV == RAIDDEV)
+    panic("ideinit: striped root needs disks 1 and 2");
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b.  Caller must hold its channel's lock.
 static void
 idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->qblockno >= FSSIZE)
     panic("incorrect blockno");
+  struct idechan *c = &chan[b->qdev/2];
   int sector_per_block =  BSIZE/SECTOR_SIZE;
-  int sector = b->blockno * sector_per_block;
+  int sector = b->qblockno * sector_per_block;
   int read_cmd = (sector_per_block == 1) ? IDE_CMD_READ :  IDE_CMD_RDMUL;
   int write_cmd = (sector_per_block == 1) ? IDE_CMD_WRITE : IDE_CMD_WRMUL;
 
   if (sector_per_block > 7) panic("idestart");
 
-  idewait(0);
-  outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
-  outb(0x1f3, sector & 0xff);
-  outb(0x1f4, (sector >> 8) & 0xff);
-  outb(0x1f5, (sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
+  idewait(c, 0);
+  outb(c->ctl, 0);  // generate interrupt
+  outb(c->base+2, sector_per_block);  // number of sectors
+  outb(c->base+3, sector & 0xff);
+  outb(c->base+4, (sector >> 8) & 0xff);
+  outb(c->base+5, (sector >> 16) & 0xff);
+  outb(c->base+6, 0xe0 | ((b->qdev&1)<<4) | ((sector>>24)&0x0f));
   if(b->flags & B_DIRTY){
-    outb(0x1f7, write_cmd);
-    outsl(0x1f0, b->data, BSIZE/4);
+    outb(c->base+7, write_cmd);
+    outsl(c->base, b->data, BSIZE/4);
   } else {
-    outb(0x1f7, read_cmd);
+    outb(c->base+7, read_cmd);
   }
 }
 
-// Interrupt handler.
+// Interrupt handler for channel n.
 void
-ideintr(void)
+ideintr(int n)
 {
+  struct idechan *c = &chan[n];
   struct buf *b;
 
   // First queued buffer is the active request.
-  acquire(&idelock);
+  acquire(&c->lock);
 
-  if((b = idequeue) == 0){
-    release(&idelock);
+  if((b = c->queue) == 0){
+    release(&c->lock);
     return;
   }
-  idequeue = b->qnext;
+  c->queue = b->qnext;
 
   // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, BSIZE/4);
+  if(!(b->flags & B_DIRTY) && idewait(c, 1) >= 0)
+    insl(c->base, b->data, BSIZE/4);
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
@@ -124,45 +173,70 @@ ideintr(void)
   wakeup(b);
 
   // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  if(c->queue != 0)
+    idestart(c->queue);
 
-  release(&idelock);
+  release(&c->lock);
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Append b to its channel's queue, starting the disk if idle.
+static void
+idequeue(struct buf *b)
 {
+  struct idechan *c = &chan[b->qdev/2];
   struct buf **pp;
 
   if(!holdingsleep(&b->lock))
     panic("iderw: buf not locked");
   if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
     panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
 
-  acquire(&idelock);  //DOC:acquire-lock
+  acquire(&c->lock);  //DOC:acquire-lock
 
-  // Append b to idequeue.
   b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
+  for(pp=&c->queue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
     ;
   *pp = b;
 
-  // Start disk if necessary.
-  if(idequeue == b)
+  if(c->queue == b)
     idestart(b);
 
-  // Wait for request to finish.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
-  }
+  release(&c->lock);
+}
+
+// Sync bufs with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+// All n are queued before waiting for any, so requests for
+// disks on different channels proceed in parallel.
+void
+iderw(struct buf **bs, int n)
+{
+  struct idechan *c;
+  struct buf *b;
+  int i;
 
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    if(b->dev == RAIDDEV){
+      b->qdev = stripe[b->blockno % NSTRIPE];
+      b->qblockno = b->blockno / NSTRIPE;
+    } else {
+      b->qdev = b->dev;
+      b->qblockno = b->blockno;
+    }
+    idequeue(b);
+  }
 
-  release(&idelock);
+  // Wait for requests to finish.
+  for(i = 0; i < n; i++){
+    b = bs[i];
+    c = &chan[b->qdev/2];
+    acquire(&c->lock);
+    while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
+      sleep(b, &c->lock);
+    }
+    release(&c->lock);
+  }
 }
@@ -1,6 +1,22 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and slabs for kmalloc(). Allocates 4096-byte pages.
+//
+// Each page has a reference count so that page-cache pages can
+// be mapped by several processes: kalloc() returns a page with
+// one reference, kref() adds one, and kfree() drops one and only
+// frees the page when the last goes.
+//
+// Idle CPUs move free pages to a pool of pre-zeroed pages with
+// kzero(), so that kalloczero() can usually skip zeroing.
+//
+// kinit2() sets aside the top NLARGE aligned LPGSIZE blocks of
+// memory as a pool for kalloclarge() to hand out whole, for large
+// page mappings.  Their pages are still separate, each with its own
+// reference, so they can be freed, and the mapping split, a page at
+// a time; a pool block goes back on the pool's list once all of its
+// pages are free again.  kalloc() only breaks up a pool block when
+// the ordinary free pages have run out.
 
 #include "types.h"
 #include "defs.h"
@@ -9,6 +25,9 @@
 #include "mmu.h"
 #include "spinlock.h"
 
+#define NZERO 512   // most pages kept in the zeroed pool
+#define NLARGE 8    // LPGSIZE blocks reserved for kalloclarge()
+
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
@@ -21,6 +40,12 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct run *zerolist;   // zeroed but for the next pointer
+  int nzero;
+  struct run *large;      // wholly free pool blocks
+  ushort ref[PHYSTOP/PGSIZE];
+  uchar pool[PHYSTOP/LPGSIZE];    // block belongs to the pool
+  ushort nfree[PHYSTOP/LPGSIZE];  // free pages of a pool block
 } kmem;
 
 // Initialization happens in two phases.
@@ -39,6 +64,11 @@ kinit1(void *vstart, void *vend)
 void
 kinit2(void *vstart, void *vend)
 {
+  uint b;
+
+  for(b = V2P(vend) / LPGSIZE; b > 0 && b > V2P(vend) / LPGSIZE - NLARGE; b--)
+    if((b-1) * LPGSIZE >= V2P(vstart))
+      kmem.pool[b-1] = 1;
   freerange(vstart, vend);
   kmem.use_lock = 1;
 }
@@ -60,22 +90,67 @@ void
 kfree(char *v)
 {
   struct run *r;
+  uint b;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  b = V2P(v) / LPGSIZE;
+  if(kmem.pool[b]){
+    if(++kmem.nfree[b] == LPGSIZE/PGSIZE){
+      r = (struct run*)P2V(b * LPGSIZE);
+      r->next = kmem.large;
+      kmem.large = r;
+    }
+  } else {
+    r = (struct run*)v;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
 }
 
+// Take a free block out of the pool and put all but its first page
+// on the free list.  Returns the first page, or 0 if the pool is
+// empty.  Caller holds kmem.lock.
+static struct run*
+breaklarge(void)
+{
+  struct run *r, *p;
+  uint b, i;
+
+  if((r = kmem.large) == 0)
+    return 0;
+  kmem.large = r->next;
+  b = V2P(r) / LPGSIZE;
+  kmem.pool[b] = 0;
+  kmem.nfree[b] = 0;
+  for(i = 1; i < LPGSIZE/PGSIZE; i++){
+    p = (struct run*)((char*)r + i*PGSIZE);
+    p->next = kmem.freelist;
+    kmem.freelist = p;
+  }
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -89,8 +164,107 @@ kalloc(void)
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
+  else if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  } else
+    r = breaklarge();
+  if(r)
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  return (char*)r;
+}
+
+// Allocate a zeroed page, from the zeroed pool if possible.
+char*
+kalloczero(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r){
+    r->next = 0;
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Zero one free page into the pool, unless it is full.  Called by
+// idle CPUs with no locks held.  Returns 1 if it zeroed a page.
+int
+kzero(void)
+{
+  struct run *r;
+
+  // Unlocked peek, so that idle CPUs do not fight over kmem.lock.
+  if(kmem.nzero >= NZERO || kmem.freelist == 0)
+    return 0;
+  acquire(&kmem.lock);
+  if(kmem.nzero >= NZERO || (r = kmem.freelist) == 0){
+    release(&kmem.lock);
+    return 0;
+  }
+  kmem.freelist = r->next;
+  kmem.nzero++;   // count it now so other CPUs do not overfill
+  release(&kmem.lock);
+
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zerolist;
+  kmem.zerolist = r;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Allocate LPGSIZE bytes of physically contiguous memory, aligned
+// for a large page, as pages with one reference each.  The memory
+// is not zeroed.  Returns 0 if the pool is empty; the caller then
+// falls back to ordinary pages.
+char*
+kalloclarge(void)
+{
+  struct run *r;
+  uint i;
+
+  acquire(&kmem.lock);
+  if((r = kmem.large) != 0){
+    kmem.large = r->next;
+    kmem.nfree[V2P(r)/LPGSIZE] = 0;
+    for(i = 0; i < LPGSIZE/PGSIZE; i++)
+      kmem.ref[V2P(r)/PGSIZE + i] = 1;
+  }
+  release(&kmem.lock);
+  return (char*)r;
+}
+
+// Add a reference to page v.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE]++ == 0)
+    panic("kref: free page");
+  release(&kmem.lock);
+}
+
+// Number of references to page v.
+int
+krefs(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
+
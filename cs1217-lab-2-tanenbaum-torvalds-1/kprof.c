@@ -0,0 +1,155 @@
+// Profile the kernel while a command runs.
+//
+// usage: kprof command [args...]
+//
+// Samples every CPU until the command exits, then prints one line
+// per distinct sampled call chain:
+//
+//   PROF <count> k <pc> <caller> <caller's caller> ...
+//   PROF <count> u <pc>
+//
+// for kernel and user samples respectively, pcs in hex, followed by
+// "PROF dropped <n>".  prof.pl turns these, captured from the
+// console, into a flat profile or flame graph input.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "prof.h"
+
+#define NBUF    64     // samples per PROF_READ
+#define NSTACK  1024   // distinct call chains kept; must be a power of two
+
+struct stack {
+  uint pc[PROF_DEPTH];
+  int user;
+  uint count;
+};
+
+static struct profsample buf[NBUF];
+static struct stack stacks[NSTACK];
+static int nstacks, lost, self;
+
+static uint
+hash(struct profsample *s)
+{
+  uint h;
+  int i;
+
+  h = s->user;
+  for(i = 0; i < PROF_DEPTH; i++)
+    h = h * 31 + s->pc[i];
+  return h;
+}
+
+static int
+same(struct stack *e, struct profsample *s)
+{
+  int i;
+
+  if(e->user != s->user)
+    return 0;
+  for(i = 0; i < PROF_DEPTH; i++)
+    if(e->pc[i] != s->pc[i])
+      return 0;
+  return 1;
+}
+
+static void
+add(struct profsample *s)
+{
+  struct stack *e;
+  uint h;
+  int i;
+
+  if(s->pid == self)
+    return;
+  for(h = hash(s);; h++){
+    e = &stacks[h & (NSTACK-1)];
+    if(e->count == 0)
+      break;
+    if(same(e, s)){
+      e->count++;
+      return;
+    }
+  }
+  if(nstacks == NSTACK - 1){   // keep one slot free to end probing
+    lost++;
+    return;
+  }
+  nstacks++;
+  for(i = 0; i < PROF_DEPTH; i++)
+    e->pc[i] = s->pc[i];
+  e->user = s->user;
+  e->count = 1;
+}
+
+static int
+drain(void)
+{
+  int i, n, total;
+
+  total = 0;
+  while((n = profctl(PROF_READ, buf, NBUF)) > 0){
+    for(i = 0; i < n; i++)
+      add(&buf[i]);
+    total += n;
+  }
+  return total;
+}
+
+// Collect samples until profiling stops, then print them.
+static void
+collect(void)
+{
+  struct stack *e;
+  int i;
+
+  self = getpid();
+  while(profctl(PROF_ACTIVE, 0, 0) == 1){
+    if(drain() == 0)
+      sleep(1);
+  }
+  drain();
+
+  for(e = stacks; e < &stacks[NSTACK]; e++){
+    if(e->count == 0)
+      continue;
+    printf(1, "PROF %d %s", e->count, e->user ? "u" : "k");
+    for(i = 0; i < PROF_DEPTH && e->pc[i]; i++)
+      printf(1, " %x", e->pc[i]);
+    printf(1, "\n");
+  }
+  printf(1, "PROF dropped %d\n", profctl(PROF_DROPPED, 0, 0) + lost);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, collector;
+
+  if(argc < 2){
+    printf(2, "usage: kprof command [args...]\n");
+    exit();
+  }
+  if(profctl(PROF_ON, 0, 0) < 0){
+    printf(2, "kprof: profiling not supported\n");
+    exit();
+  }
+  if((collector = fork()) == 0)
+    collect();
+  if((pid = fork()) == 0){
+    exec(argv[1], argv + 1);
+    printf(2, "kprof: exec %s failed\n", argv[1]);
+    exit();
+  }
+  if(collector < 0 || pid < 0)
+    printf(2, "kprof: fork failed\n");
+
+  while(pid > 0 && wait() != pid)
+    ;
+  profctl(PROF_OFF, 0, 0);
+  wait();
+  exit();
+}
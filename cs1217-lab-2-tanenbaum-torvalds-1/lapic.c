@@ -60,12 +60,12 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from
+  // lapic[TICR] and then issues an interrupt.  timerintr()
+  // rearms it for the next deadline, using the rate that
+  // timerinit() calibrates; this first count just gets it going.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
   lapicw(TICR, 10000000);
 
   // Disable logical interrupt lines.
@@ -105,6 +105,23 @@ lapicid(void)
   return lapic[ID] >> 24;
 }
 
+// Start the timer counting down from count; it interrupts at zero.
+void
+lapiconeshot(uint count)
+{
+  if(lapic)
+    lapicw(TICR, count);
+}
+
+// Read the timer's current count.
+uint
+lapiccount(void)
+{
+  if(!lapic)
+    return 0;
+  return lapic[TCCR];
+}
+
 // Acknowledge interrupt.
 void
 lapiceoi(void)
@@ -27,10 +27,24 @@
 //   block B
 //   block C
 //   ...
-// Log appends are synchronous.
+// Log appends are synchronous, but LOGBATCH blocks at a time go
+// to the disk driver together, so a striped root device writes
+// them in parallel.
+//
+// In ordered mode (sysctl CTL_ORDERED) a transaction logs only
+// metadata.  writei() writes the data blocks of regular files
+// straight to their home locations, before end_op() gets to the
+// commit record, so each data block is written once instead of
+// twice and does not use log space.  After a crash a file may hold
+// new data under old metadata, but never another file's blocks:
+// blocks freed by a transaction stay allocated until it commits
+// (log_deferfree()), so they cannot be reused and overwritten in
+// place while the old contents are still reachable on disk.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
+#define LOGBATCH 4
+
 struct logheader {
   int n;
   int block[LOGSIZE];
@@ -43,10 +57,15 @@ struct log {
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
   int dev;
+  int ordered;     // this transaction keeps file data out of the log
+  int nfreed;      // blocks to free at commit, in ordered mode
+  uint freed[FSSIZE];
   struct logheader lh;
 };
 struct log log;
 
+int logordered;    // CTL_ORDERED; read at the start of each transaction
+
 static void recover_from_log(void);
 static void commit();
 
@@ -65,20 +84,37 @@ initlog(int dev)
   recover_from_log();
 }
 
+// Write out and release the n bufs in batch.
+static void
+flush_batch(struct buf **batch, int n)
+{
+  int i;
+
+  bwritev(batch, n);
+  for (i = 0; i < n; i++)
+    brelse(batch[i]);
+}
+
 // Copy committed blocks from log to their home location
 static void
 install_trans(void)
 {
-  int tail;
+  struct buf *batch[LOGBATCH];
+  int tail, n;
 
+  n = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
     struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
     brelse(lbuf);
-    brelse(dbuf);
+    batch[n++] = dbuf;
+    if (n == LOGBATCH) {
+      flush_batch(batch, n);  // write dst to disk
+      n = 0;
+    }
   }
+  flush_batch(batch, n);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -133,6 +169,8 @@ begin_op(void)
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
+      if(log.outstanding == 0)
+        log.ordered = logordered;
       log.outstanding += 1;
       release(&log.lock);
       break;
@@ -177,21 +215,33 @@ end_op(void)
 static void
 write_log(void)
 {
-  int tail;
+  struct buf *batch[LOGBATCH];
+  int tail, n;
 
+  n = 0;
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *to = bread(log.dev, log.start+tail+1); // log block
     struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
     brelse(from);
-    brelse(to);
+    batch[n++] = to;
+    if (n == LOGBATCH) {
+      flush_batch(batch, n);  // write the log
+      n = 0;
+    }
   }
+  flush_batch(batch, n);
 }
 
 static void
 commit()
 {
+  int i;
+
+  // Frees deferred by log_deferfree() join this transaction.
+  for (i = 0; i < log.nfreed; i++)
+    bclear(log.dev, log.freed[i]);
+  log.nfreed = 0;
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
@@ -217,7 +267,7 @@ log_write(struct buf *b)
 
   if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
     panic("too big a transaction");
-  if (log.outstanding < 1)
+  if (log.outstanding < 1 && !log.committing)
     panic("log_write outside of trans");
 
   acquire(&log.lock);
@@ -232,3 +282,27 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+
+// Is the current transaction in ordered mode?  Only meaningful
+// between begin_op() and end_op().
+int
+log_ordered(void)
+{
+  return log.ordered;
+}
+
+// In ordered mode, note that block b is to be freed when the
+// current transaction commits, and return 1.  Otherwise return 0
+// and let the caller free it now.
+int
+log_deferfree(uint b)
+{
+  if(!log.ordered)
+    return 0;
+  acquire(&log.lock);
+  if(log.nfreed >= FSSIZE)
+    panic("log_deferfree");
+  log.freed[log.nfreed++] = b;
+  release(&log.lock);
+  return 1;
+}
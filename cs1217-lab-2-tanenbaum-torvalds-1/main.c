@@ -21,6 +21,7 @@ main(void)
 {
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
+  slabinit();      // small-object allocator
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
   seginit();       // segment descriptors
@@ -28,10 +29,17 @@ main(void)
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
+  timerinit();     // calibrate TSC
   pinit();         // process table
+  traceinit();     // scheduler event tracing
+  profinit();      // kernel profiler
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcacheinit();    // page cache
+  aioinit();       // asynchronous I/O
   fileinit();      // file table
+  mountinit();     // mount table
+  tmpinit();       // in-memory file system
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -57,22 +65,23 @@ mpmain(void)
   idtinit();       // load idt register
   xchg(&(mycpu()->started), 1); // tell startothers() we're up
 
-  switch(SCHEDULER)
-  {
-    case S_BASIC:
-      scheduler();
-    break;
-
-    case S_LOTTERY:
-      scheduler_lottery();
-    break;
-
-    case S_MLFQ:
-      scheduler_mlfq();
-    break;
+  // Each scheduler returns when sysctl() switches policy.
+  for(;;){
+    switch(SCHEDULER)
+    {
+      case S_BASIC:
+        scheduler();
+      break;
+
+      case S_LOTTERY:
+        scheduler_lottery();
+      break;
+
+      case S_MLFQ:
+        scheduler_mlfq();
+      break;
+    }
   }
-
-  scheduler();
 }
 
 pde_t entrypgdir[];  // For entry.S
@@ -0,0 +1,221 @@
+// Compare the segregated-fit malloc in umalloc.c with the
+// Kernighan and Ritchie first-fit allocator it replaced.
+//
+// usage: mallocbench [rounds]
+//
+// Each workload runs against both allocators and prints the
+// elapsed ticks, one line per workload:
+//   mallocbench <workload> kr <ticks> seg <ticks>
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSLOT 512
+
+// The old allocator, kept here verbatim apart from names.
+
+typedef long Align;
+
+union header {
+  struct {
+    union header *ptr;
+    uint size;
+  } s;
+  Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+
+static void
+kr_free(void *ap)
+{
+  Header *bp, *p;
+
+  bp = (Header*)ap - 1;
+  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+      break;
+  if(bp + bp->s.size == p->s.ptr){
+    bp->s.size += p->s.ptr->s.size;
+    bp->s.ptr = p->s.ptr->s.ptr;
+  } else
+    bp->s.ptr = p->s.ptr;
+  if(p + p->s.size == bp){
+    p->s.size += bp->s.size;
+    p->s.ptr = bp->s.ptr;
+  } else
+    p->s.ptr = bp;
+  freep = p;
+}
+
+static Header*
+kr_morecore(uint nu)
+{
+  char *p;
+  Header *hp;
+
+  if(nu < 4096)
+    nu = 4096;
+  p = sbrk(nu * sizeof(Header));
+  if(p == (char*)-1)
+    return 0;
+  hp = (Header*)p;
+  hp->s.size = nu;
+  kr_free((void*)(hp + 1));
+  return freep;
+}
+
+static void*
+kr_malloc(uint nbytes)
+{
+  Header *p, *prevp;
+  uint nunits;
+
+  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  if((prevp = freep) == 0){
+    base.s.ptr = freep = prevp = &base;
+    base.s.size = 0;
+  }
+  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
+    if(p->s.size >= nunits){
+      if(p->s.size == nunits)
+        prevp->s.ptr = p->s.ptr;
+      else {
+        p->s.size -= nunits;
+        p += p->s.size;
+        p->s.size = nunits;
+      }
+      freep = prevp;
+      return (void*)(p + 1);
+    }
+    if(p == freep)
+      if((p = kr_morecore(nunits)) == 0)
+        return 0;
+  }
+}
+
+// Workloads, parameterized by the allocator under test.
+
+struct allocator {
+  void *(*alloc)(uint);
+  void (*free)(void*);
+};
+
+static struct allocator kr = { kr_malloc, kr_free };
+static struct allocator seg = { malloc, free };
+
+static void *slot[NSLOT];
+static unsigned long randstate = 1;
+
+static uint
+rand(void)
+{
+  randstate = randstate * 1664525 + 1013904223;
+  return randstate >> 8;
+}
+
+static void
+fail(char *what)
+{
+  printf(2, "mallocbench: %s: out of memory\n", what);
+  exit();
+}
+
+// Allocate NSLOT small blocks, then free them all, in LIFO order
+// like sh.c's command trees.
+static void
+lifo(struct allocator *a, int rounds)
+{
+  int r, i;
+
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < NSLOT; i++)
+      if((slot[i] = a->alloc(8 + (i % 7) * 8)) == 0)
+        fail("lifo");
+    for(i = NSLOT - 1; i >= 0; i--)
+      a->free(slot[i]);
+  }
+}
+
+// Keep NSLOT live blocks of random sizes and repeatedly replace a
+// random one, which fragments a first-fit free list.
+static void
+churn(struct allocator *a, int rounds)
+{
+  int r, i;
+
+  for(i = 0; i < NSLOT; i++)
+    if((slot[i] = a->alloc(8 + rand() % 504)) == 0)
+      fail("churn");
+  for(r = 0; r < rounds * NSLOT; r++){
+    i = rand() % NSLOT;
+    a->free(slot[i]);
+    if((slot[i] = a->alloc(8 + rand() % 504)) == 0)
+      fail("churn");
+  }
+  for(i = 0; i < NSLOT; i++)
+    a->free(slot[i]);
+}
+
+// Mostly small blocks with an occasional large buffer.
+static void
+mixed(struct allocator *a, int rounds)
+{
+  int r, i;
+
+  for(r = 0; r < rounds; r++){
+    for(i = 0; i < NSLOT; i++){
+      if((slot[i] = a->alloc(i % 64 == 0 ? 8192 : 16 + rand() % 112)) == 0)
+        fail("mixed");
+    }
+    for(i = 0; i < NSLOT; i += 2)
+      a->free(slot[i]);
+    for(i = 1; i < NSLOT; i += 2)
+      a->free(slot[i]);
+  }
+}
+
+static struct {
+  char *name;
+  void (*run)(struct allocator*, int);
+} workloads[] = {
+  { "lifo", lifo },
+  { "churn", churn },
+  { "mixed", mixed },
+};
+
+static int
+timeit(void (*run)(struct allocator*, int), struct allocator *a, int rounds)
+{
+  int start;
+
+  randstate = 1;
+  start = uptime();
+  run(a, rounds);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, rounds, tkr, tseg;
+
+  rounds = 50;
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds < 1){
+    printf(2, "usage: mallocbench [rounds]\n");
+    exit();
+  }
+
+  for(i = 0; i < sizeof(workloads)/sizeof(workloads[0]); i++){
+    tkr = timeit(workloads[i].run, &kr, rounds);
+    tseg = timeit(workloads[i].run, &seg, rounds);
+    printf(1, "mallocbench %s kr %d seg %d\n", workloads[i].name, tkr, tseg);
+  }
+  exit();
+}
@@ -26,7 +26,8 @@ int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
-int fsfd;
+int fsfd[NSTRIPE];
+int nfsfd = 1;  // images the file system is striped over
 struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
@@ -67,7 +68,7 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
+  int i, cc, fd, first;
   uint rootino, inum, off;
   struct dirent de;
   char buf[BSIZE];
@@ -76,18 +77,28 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
+  // With -s, stripe the blocks round-robin over NSTRIPE images,
+  // one per disk of the kernel's RAIDDEV.
+  first = 1;
+  if(argc > 1 && strcmp(argv[1], "-s") == 0){
+    nfsfd = NSTRIPE;
+    first = 2;
+  }
+  if(argc < first + nfsfd){
     fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "       mkfs -s fs0.img ... fs%d.img files...\n", NSTRIPE-1);
     exit(1);
   }
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
 
-  fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
-  if(fsfd < 0){
-    perror(argv[1]);
-    exit(1);
+  for(i = 0; i < nfsfd; i++){
+    fsfd[i] = open(argv[first+i], O_RDWR|O_CREAT|O_TRUNC, 0666);
+    if(fsfd[i] < 0){
+      perror(argv[first+i]);
+      exit(1);
+    }
   }
 
   // 1 fs block = 1 disk sector
@@ -127,7 +138,7 @@ main(int argc, char *argv[])
   strcpy(de.name, "..");
   iappend(rootino, &de, sizeof(de));
 
-  for(i = 2; i < argc; i++){
+  for(i = first + nfsfd; i < argc; i++){
     assert(index(argv[i], '/') == 0);
 
     if((fd = open(argv[i], 0)) < 0){
@@ -170,11 +181,14 @@ main(int argc, char *argv[])
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
+  int fd = fsfd[sec % nfsfd];
+  uint off = sec / nfsfd * BSIZE;
+
+  if(lseek(fd, off, 0) != off){
     perror("lseek");
     exit(1);
   }
-  if(write(fsfd, buf, BSIZE) != BSIZE){
+  if(write(fd, buf, BSIZE) != BSIZE){
     perror("write");
     exit(1);
   }
@@ -210,11 +224,14 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
+  int fd = fsfd[sec % nfsfd];
+  uint off = sec / nfsfd * BSIZE;
+
+  if(lseek(fd, off, 0) != off){
     perror("lseek");
     exit(1);
   }
-  if(read(fsfd, buf, BSIZE) != BSIZE){
+  if(read(fd, buf, BSIZE) != BSIZE){
     perror("read");
     exit(1);
   }
@@ -2,6 +2,7 @@
 // x86 memory management unit (MMU).
 
 // Eflags register
+#define FL_TF           0x00000100      // Trap Flag
 #define FL_IF           0x00000200      // Interrupt Enable
 
 // Control Register flags
@@ -11,6 +12,11 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// Model-specific registers for sysenter/sysexit
+#define MSR_SYSENTER_CS  0x174          // kernel code selector
+#define MSR_SYSENTER_ESP 0x175          // kernel stack pointer
+#define MSR_SYSENTER_EIP 0x176          // kernel entry point
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
@@ -83,6 +89,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define LPGSIZE         (NPTENTRIES*PGSIZE) // bytes mapped by a large (PSE) page
 
 #define PTXSHIFT        12      // offset of PTX in a linear address
 #define PDXSHIFT        22      // offset of PDX in a linear address
@@ -95,6 +102,8 @@ struct segdesc {
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
 #define PTE_PS          0x080   // Page Size
+#define PTE_SHARED      0x200   // Page may be mapped elsewhere (software bit)
+#define PTE_COW         0x400   // Copy page on write (software bit)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -0,0 +1,414 @@
+// Operating system microbenchmarks, after lmbench.
+//
+// usage: osbench [test [reps]]
+//
+// Runs a test reps times (default 100) after a warmup of reps/10
+// runs, and reports the cost of one operation in cycles: the
+// minimum, median, and 90th and 99th percentiles over the runs.
+// Tests:
+//
+//   null       getpid(), the cheapest system call
+//   ctx        context switch: half a one-byte round trip between
+//              two processes over a pair of pipes
+//   fork       fork() and exit(), reaped with wait()
+//   exec       fork() and exec() of a program that exits at once
+//   fault      first touch of a zero-fill (bss) page
+//   create     create, close and unlink an empty file
+//   seqread    read a file 4 KB at a time
+//   seqwrite   overwrite a file 4 KB at a time
+//   randread   4 KB reads at random offsets
+//   randwrite  4 KB writes at random offsets
+//   sbrk       grow the heap by a page
+//   all        every test in turn (the default)
+//
+// All output is on lines of the form
+//
+//   BENCH os test=null reps=100 min=... median=... p90=... p99=...
+//
+// with mbps= added for the file tests.  osbench.pl compares the
+// lines from two captured console logs, so a kernel change can be
+// judged against a baseline.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "schedtrace.h"
+
+#define PGSIZE 4096
+#define MAXREPS 2000
+#define NCALL 100         // system calls or round trips per null, ctx run
+#define NFAULT 16         // pages faulted per fault run
+#define NBLOCK 64         // 4 KB blocks in the test file, and per I/O run
+#define NGROW 16          // pages added per sbrk run
+
+static char file[] = "osbench.tmp";
+static char buf[PGSIZE];
+static char region[NFAULT * PGSIZE] __attribute__((aligned(PGSIZE)));
+static uint samples[MAXREPS];
+static unsigned long randstate = 1;
+static int mhz;
+static int fd;
+static int ping[2], pong[2];
+static int echopid;
+
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+static uint
+rand(void)
+{
+  randstate = randstate * 1664525 + 1013904223;
+  return randstate >> 8;
+}
+
+// cycles / n, saturating; there is no libgcc.
+static uint
+perop(unsigned long long cycles, uint n)
+{
+  uint hi, lo, q, r;
+
+  hi = cycles >> 32;
+  lo = cycles;
+  if(hi >= n)
+    return 0xffffffff;
+  asm("divl %4" : "=a"(q), "=d"(r) : "0"(lo), "1"(hi), "rm"(n));
+  return q;
+}
+
+static void
+fail(char *what)
+{
+  printf(2, "osbench: %s failed\n", what);
+  exit();
+}
+
+// Each test's run function performs one repetition and returns
+// the cycles it took; setup and teardown run outside the timing.
+
+static unsigned long long
+null(void)
+{
+  unsigned long long t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < NCALL; i++)
+    getpid();
+  return rdtsc() - t0;
+}
+
+// A child that echoes every byte on ping back on pong.
+static void
+ctxsetup(void)
+{
+  char c;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0)
+    fail("pipe");
+  if((echopid = fork()) < 0)
+    fail("fork");
+  if(echopid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      if(write(pong[1], &c, 1) != 1)
+        break;
+    exit();
+  }
+  close(ping[0]);
+  close(pong[1]);
+}
+
+static unsigned long long
+ctx(void)
+{
+  unsigned long long t0;
+  char c;
+  int i;
+
+  c = 0;
+  t0 = rdtsc();
+  for(i = 0; i < NCALL; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1)
+      fail("ping-pong");
+  }
+  return rdtsc() - t0;
+}
+
+static void
+ctxteardown(void)
+{
+  close(ping[1]);
+  close(pong[0]);
+  wait();
+}
+
+static unsigned long long
+forkexit(void)
+{
+  unsigned long long t0;
+  int pid;
+
+  t0 = rdtsc();
+  if((pid = fork()) == 0)
+    exit();
+  if(pid < 0)
+    fail("fork");
+  wait();
+  return rdtsc() - t0;
+}
+
+static unsigned long long
+forkexec(void)
+{
+  static char *argv[] = { "osbench", "-exit", 0 };
+  unsigned long long t0;
+  int pid;
+
+  t0 = rdtsc();
+  if((pid = fork()) == 0){
+    exec("/osbench", argv);
+    printf(2, "osbench: exec /osbench failed\n");
+    exit();
+  }
+  if(pid < 0)
+    fail("fork");
+  wait();
+  return rdtsc() - t0;
+}
+
+// exec() leaves bss pages unmapped until first touched, and
+// fork() copies only the pages the parent has mapped.  So region
+// is untouched in each new child, which times its first writes
+// to it and sends the time back up a pipe.
+static unsigned long long
+fault(void)
+{
+  unsigned long long t0, t;
+  int i, p[2], pid;
+
+  if(pipe(p) < 0)
+    fail("pipe");
+  if((pid = fork()) == 0){
+    close(p[0]);
+    t0 = rdtsc();
+    for(i = 0; i < NFAULT; i++)
+      region[i * PGSIZE] = 2;
+    t = rdtsc() - t0;
+    write(p[1], &t, sizeof(t));
+    exit();
+  }
+  if(pid < 0)
+    fail("fork");
+  close(p[1]);
+  if(read(p[0], &t, sizeof(t)) != sizeof(t))
+    t = 0;
+  close(p[0]);
+  wait();
+  return t;
+}
+
+static unsigned long long
+create(void)
+{
+  unsigned long long t0;
+  int f;
+
+  t0 = rdtsc();
+  if((f = open(file, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  close(f);
+  if(unlink(file) < 0)
+    fail("unlink");
+  return rdtsc() - t0;
+}
+
+// Write the test file and leave it open.
+static void
+filesetup(void)
+{
+  int i;
+
+  if((fd = open(file, O_CREATE | O_RDWR)) < 0)
+    fail("create");
+  memset(buf, 'a', sizeof(buf));
+  for(i = 0; i < NBLOCK; i++)
+    if(write(fd, buf, PGSIZE) != PGSIZE)
+      fail("write");
+}
+
+static void
+fileteardown(void)
+{
+  close(fd);
+  unlink(file);
+}
+
+static unsigned long long
+seqread(void)
+{
+  unsigned long long t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < NBLOCK; i++)
+    if(pread(fd, buf, PGSIZE, i * PGSIZE) != PGSIZE)
+      fail("read");
+  return rdtsc() - t0;
+}
+
+static unsigned long long
+seqwrite(void)
+{
+  unsigned long long t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < NBLOCK; i++)
+    if(pwrite(fd, buf, PGSIZE, i * PGSIZE) != PGSIZE)
+      fail("write");
+  return rdtsc() - t0;
+}
+
+static unsigned long long
+randread(void)
+{
+  unsigned long long t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < NBLOCK; i++)
+    if(pread(fd, buf, PGSIZE, rand() % NBLOCK * PGSIZE) != PGSIZE)
+      fail("read");
+  return rdtsc() - t0;
+}
+
+static unsigned long long
+randwrite(void)
+{
+  unsigned long long t0;
+  int i;
+
+  t0 = rdtsc();
+  for(i = 0; i < NBLOCK; i++)
+    if(pwrite(fd, buf, PGSIZE, rand() % NBLOCK * PGSIZE) != PGSIZE)
+      fail("write");
+  return rdtsc() - t0;
+}
+
+static unsigned long long
+grow(void)
+{
+  unsigned long long t;
+  int i;
+
+  t = rdtsc();
+  for(i = 0; i < NGROW; i++)
+    if(sbrk(PGSIZE) == (char*)-1)
+      fail("sbrk");
+  t = rdtsc() - t;
+  sbrk(-NGROW * PGSIZE);
+  return t;
+}
+
+static struct test {
+  char *name;
+  unsigned long long (*run)(void);
+  void (*setup)(void);
+  void (*teardown)(void);
+  int ops;            // operations per run
+  int io;             // ops move PGSIZE bytes each
+} tests[] = {
+  { "null", null, 0, 0, NCALL, 0 },
+  { "ctx", ctx, ctxsetup, ctxteardown, 2 * NCALL, 0 },
+  { "fork", forkexit, 0, 0, 1, 0 },
+  { "exec", forkexec, 0, 0, 1, 0 },
+  { "fault", fault, 0, 0, NFAULT, 0 },
+  { "create", create, 0, 0, 1, 0 },
+  { "seqread", seqread, filesetup, fileteardown, NBLOCK, 1 },
+  { "seqwrite", seqwrite, filesetup, fileteardown, NBLOCK, 1 },
+  { "randread", randread, filesetup, fileteardown, NBLOCK, 1 },
+  { "randwrite", randwrite, filesetup, fileteardown, NBLOCK, 1 },
+  { "sbrk", grow, 0, 0, NGROW, 0 },
+};
+
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+static void
+sort(uint *a, int n)
+{
+  int gap, i, j;
+  uint x;
+
+  for(gap = n / 2; gap > 0; gap /= 2)
+    for(i = gap; i < n; i++){
+      x = a[i];
+      for(j = i; j >= gap && a[j - gap] > x; j -= gap)
+        a[j] = a[j - gap];
+      a[j] = x;
+    }
+}
+
+static void
+bench(struct test *t, int reps)
+{
+  int i, warmup;
+  uint med;
+
+  randstate = 1;
+  if(t->setup)
+    t->setup();
+  warmup = reps / 10 > 0 ? reps / 10 : 1;
+  for(i = 0; i < warmup; i++)
+    t->run();
+  for(i = 0; i < reps; i++)
+    samples[i] = perop(t->run(), t->ops);
+  if(t->teardown)
+    t->teardown();
+
+  sort(samples, reps);
+  med = samples[(reps - 1) / 2];
+  printf(1, "BENCH os test=%s reps=%d min=%d median=%d p90=%d p99=%d",
+         t->name, reps, samples[0], med,
+         samples[(reps - 1) * 90 / 100], samples[(reps - 1) * 99 / 100]);
+  // bytes per microsecond is MB/s.
+  if(t->io)
+    printf(1, " mbps=%d", med ? perop((unsigned long long)PGSIZE * mhz, med) : 0);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *name;
+  int i, reps, found;
+
+  if(argc > 1 && strcmp(argv[1], "-exit") == 0)
+    exit();    // the program exec runs
+  name = argc > 1 ? argv[1] : "all";
+  reps = argc > 2 ? atoi(argv[2]) : 100;
+  if(reps < 1 || reps > MAXREPS){
+    printf(2, "usage: osbench [test [reps]]\n");
+    exit();
+  }
+  if((mhz = schedtrace(TRACE_MHZ, 0, 0)) <= 0)
+    mhz = 1;
+
+  found = 0;
+  for(i = 0; i < NTEST; i++){
+    if(strcmp(name, "all") == 0 || strcmp(name, tests[i].name) == 0){
+      bench(&tests[i], reps);
+      found = 1;
+    }
+  }
+  if(!found)
+    printf(2, "osbench: no test %s\n", name);
+  exit();
+}
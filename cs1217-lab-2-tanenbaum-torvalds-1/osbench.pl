@@ -0,0 +1,61 @@
+#!/usr/bin/perl
+
+# Compare osbench results from captured xv6 console logs.
+#
+# usage: ./osbench.pl base.log [new.log]
+#
+# Reads the "BENCH os" lines that osbench prints and takes the
+# median cycles per operation of each test, averaged over runs.
+# With one log, prints them; with two, prints both and the change
+# from the first (the baseline) to the second, in percent.
+
+sub readlog {
+	my ($file) = @_;
+	my (%sum, %n, $kv, $k, $v, %f);
+
+	open(LOG, $file) || die "osbench.pl: cannot open $file\n";
+	while(<LOG>){
+		s/\r//g;
+		next unless /^BENCH os (.*)$/;
+		%f = ();
+		foreach $kv (split(' ', $1)){
+			($k, $v) = split(/=/, $kv, 2);
+			$f{$k} = $v;
+		}
+		push(@order, $f{test}) unless exists $seen{$f{test}};
+		$seen{$f{test}} = 1;
+		$sum{$f{test}} += $f{median};
+		$n{$f{test}}++;
+	}
+	close(LOG);
+	foreach $k (keys %sum){
+		$sum{$k} /= $n{$k};
+	}
+	return %sum;
+}
+
+if(@ARGV < 1 || @ARGV > 2){
+	print STDERR "usage: osbench.pl base.log [new.log]\n";
+	exit 1;
+}
+%base = readlog($ARGV[0]);
+%new = readlog($ARGV[1]) if @ARGV == 2;
+
+if(@ARGV == 1){
+	printf("%-10s %12s\n", "test", "median");
+	foreach $t (@order){
+		printf("%-10s %12d\n", $t, $base{$t});
+	}
+	exit 0;
+}
+printf("%-10s %12s %12s %8s\n", "test", "base", "new", "change");
+foreach $t (@order){
+	if(!exists $base{$t} || !exists $new{$t}){
+		printf("%-10s %12s %12s %8s\n", $t,
+			exists $base{$t} ? int($base{$t} + 0.5) : "-",
+			exists $new{$t} ? int($new{$t} + 0.5) : "-", "");
+		next;
+	}
+	printf("%-10s %12d %12d %+7.1f%%\n", $t, $base{$t} + 0.5, $new{$t} + 0.5,
+		$base{$t} ? 100 * ($new{$t} - $base{$t}) / $base{$t} : 0);
+}
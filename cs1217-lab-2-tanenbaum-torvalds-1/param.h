@@ -1,14 +1,25 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC       512  // default limit on processes (sysctl maxproc)
+#define MAXPROC    8192  // highest limit maxproc may be set to
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
+#define NBDEV         8  // maximum block device number
+#define RAIDDEV       4  // device number of disks 1 and 2 striped
+#define NSTRIPE       2  // disks RAIDDEV stripes over
+#ifdef STRIPE
+#define ROOTDEV RAIDDEV  // device number of file system root disk
+#else
 #define ROOTDEV       1  // device number of file system root disk
+#endif
+#define TMPDEV        8  // device number of the in-memory tmpfs
+#define NMOUNT        4  // mount table entries
 #define MAXARG       32  // max exec arguments
+#define NSEG          4  // loadable program segments per process
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define TICK_US     10000  // clock tick length in microseconds
+#define QUANTUM_US  10000  // default time slice in microseconds
 
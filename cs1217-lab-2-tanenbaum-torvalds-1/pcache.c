@@ -0,0 +1,163 @@
+// Page cache for executable files.
+//
+// Program pages are mapped straight from this cache when first
+// touched (see loadfault() in exec.c) instead of being read into
+// private pages, so every process running the same binary shares
+// one copy of its text.  A cached page holds PGSIZE bytes (or fewer, zero-filled,
+// at the end of a segment) read from a given offset of an inode,
+// and is identified by (dev, inum, offset, length): segments need
+// not start on a page boundary in the file.
+//
+// The cache holds one reference to each page (see kref() in
+// kalloc.c) and every process mapping it holds another, so a page
+// dropped from the cache stays valid for processes still using it.
+// Pages are dropped least recently used first once there are more
+// than NPCACHE, and all pages of an inode are dropped when it is
+// written or truncated.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCACHE  256    // pages kept
+#define NPCHASH  64     // must be a power of two
+#define PCHASH(dev, inum) (((dev) * 31 + (inum)) & (NPCHASH-1))
+
+struct pcpage {
+  uint dev;
+  uint inum;
+  uint off;             // file offset of the first byte
+  uint n;               // bytes from the file; the rest is zero
+  char *page;
+  struct pcpage *hnext; // hash chain; all pages of an inode share one
+  struct pcpage *prev;  // LRU list, most recent first
+  struct pcpage *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct pcpage *hash[NPCHASH];
+  struct pcpage lru;    // list head
+  int n;
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.lru.next = &pcache.lru;
+  pcache.lru.prev = &pcache.lru;
+}
+
+static void
+lruunlink(struct pcpage *e)
+{
+  e->prev->next = e->next;
+  e->next->prev = e->prev;
+}
+
+static void
+lrufront(struct pcpage *e)
+{
+  e->next = pcache.lru.next;
+  e->prev = &pcache.lru;
+  pcache.lru.next->prev = e;
+  pcache.lru.next = e;
+}
+
+// Remove e from the cache and drop the cache's reference to its
+// page.  Caller must hold pcache.lock.
+static void
+pcdrop(struct pcpage *e)
+{
+  struct pcpage **pp;
+
+  for(pp = &pcache.hash[PCHASH(e->dev, e->inum)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == e){
+      *pp = e->hnext;
+      break;
+    }
+  }
+  lruunlink(e);
+  pcache.n--;
+  kfree(e->page);
+  kmfree(e);
+}
+
+// Return a page holding n bytes of ip starting at off, followed by
+// zeros, with a reference for the caller, who releases it with
+// kfree().  Returns 0 on error.  Caller must hold ip->lock.
+char*
+pcacheget(struct inode *ip, uint off, uint n)
+{
+  struct pcpage *e;
+  char *page;
+
+  if(n > PGSIZE)
+    panic("pcacheget");
+
+  acquire(&pcache.lock);
+  for(e = pcache.hash[PCHASH(ip->dev, ip->inum)]; e; e = e->hnext){
+    if(e->dev == ip->dev && e->inum == ip->inum && e->off == off && e->n == n){
+      lruunlink(e);
+      lrufront(e);
+      kref(e->page);
+      release(&pcache.lock);
+      return e->page;
+    }
+  }
+  release(&pcache.lock);
+
+  // Miss.  Holding ip->lock keeps anyone else from filling
+  // or invalidating this inode's pages meanwhile.
+  if((page = kalloczero()) == 0)
+    return 0;
+  if(readi(ip, page, off, n) != n){
+    kfree(page);
+    return 0;
+  }
+  if((e = kmalloc(sizeof(*e))) == 0)
+    return page;    // uncached, but still usable
+
+  e->dev = ip->dev;
+  e->inum = ip->inum;
+  e->off = off;
+  e->n = n;
+  e->page = page;
+  kref(page);       // one for the cache, one for the caller
+
+  acquire(&pcache.lock);
+  e->hnext = pcache.hash[PCHASH(e->dev, e->inum)];
+  pcache.hash[PCHASH(e->dev, e->inum)] = e;
+  lrufront(e);
+  if(++pcache.n > NPCACHE)
+    pcdrop(pcache.lru.prev);
+  release(&pcache.lock);
+  return page;
+}
+
+// Drop all cached pages of ip, whose contents are about to change.
+// Processes already mapping them keep the old contents.
+void
+pcacheinval(struct inode *ip)
+{
+  struct pcpage *e, *next;
+  int h;
+
+  h = PCHASH(ip->dev, ip->inum);
+  if(pcache.hash[h] == 0)   // common case: nothing of ip cached
+    return;
+
+  acquire(&pcache.lock);
+  for(e = pcache.hash[h]; e; e = next){
+    next = e->hnext;
+    if(e->dev == ip->dev && e->inum == ip->inum)
+      pcdrop(e);
+  }
+  release(&pcache.lock);
+}
@@ -6,40 +6,127 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "pstat.h"
 #include "benchinfo.h"
-
+#include "schedtrace.h"
+#include "currency.h"
+
+#define NPIDHASH 1024       // must be a power of two
+#define PIDHASH(pid) ((pid) & (NPIDHASH-1))
+#define NSLEEPHASH 256      // must be a power of two
+#define SLEEPHASH(chan) (((uint)(chan) >> 3) & (NSLEEPHASH-1))
+
+// struct procs are carved out of pages as they are needed, and
+// go on the free list rather than back to kalloc() when their
+// process is reaped, so a stale struct proc pointer still points
+// at a struct proc.  The live ones (every state but UNUSED) are
+// on list in pid order; sleeping ones are also hashed on their
+// channel, so wakeup() looks only at those that might match.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
+  struct proc *list;        // live processes, lowest pid first
+  struct proc *tail;
+  struct proc *free;        // unused struct procs, linked by next
+  int nproc;                // processes on list
   uint PromoteAtTime;
+  int nedf;                 // processes in the EDF class
+  uint edfutil;             // per-mille of a CPU they have reserved
+  struct proc *pidhash[NPIDHASH];
+  struct proc *sleephash[NSLEEPHASH];
 } ptable;
 
+int maxproc = NPROC;        // limit on ptable.nproc, set by sysctl()
+
+// Earliest start of a new period among throttled EDF processes,
+// or 0.  Other processes' time slices end no later than this.
+static uint64 edfnext;
+
+// Set when an EDF process becomes runnable, so the timer interrupt
+// preempts non-EDF processes; cleared once none is eligible.
+static volatile int edfkick;
+
+// Runnable processes outside the EDF class, linked through rnext
+// and rprev in the order they became runnable, with their lottery
+// tickets summed per currency.  setstate() keeps it up to date.
+// The basic scheduler runs them in turn; the lottery draws first
+// a currency and then a process of it.
+static struct {
+  struct proc *head;
+  struct proc *tail;
+  uint64 tickets[NCURRENCY];  // tickets of its processes
+  uint64 weight[NCURRENCY];   // the same, times their compensation
+} runq;
+
+// Runnable EDF processes, in two heaps ordered by deadline: those
+// with budget left, and those throttled until their next period.
+// Admission control keeps them to EDF_MAXUTIL.
+struct edfheap {
+  struct proc *p[EDF_MAXUTIL];
+  int n;
+};
+static struct edfheap edfready, edfwait;
+
+// MLFQ run queues, one per level, linked through qnext and qprev.
 struct pqueue {
-  struct proc *queue[NPROC];
-  int head;
-  int tail;
-} mlfq[MAXPRIORITY + 1];
+  struct proc *head;
+  struct proc *tail;
+} mlfq[NPRIO];
+
+// Scheduler tunables, set at run time through sysctl().
+int mlfqbudget = DEFAULT_BUDGET;
+int boostticks = TICKS_TO_PROMOTE;
+int maxprio = MAXPRIORITY;
+int randseed = SEED;
+int autotune;
+int resptarget = TUNE_RESP_US;
+
+// Auto-tuner statistics for the current interval.
+// Protected by ptable.lock.
+static struct {
+  uint64 resp;      // cycles from wakeup to running, summed
+  uint nresp;
+  uint preempts;    // time slices that ran out
+  uint blocks;      // time slices ended by sleeping
+  uint next;        // ticks at the next adjustment
+} tune;
+
+// Lottery currencies; see currency.h.  A currency's parent always
+// has a lower index, so a single pass down the table carries
+// activity up the tree.  Protected by ptable.lock.
+static struct {
+  int used;
+  int parent;
+  uint funding;             // tickets of the parent
+} currencies[NCURRENCY] = {
+  [0] = { 1, 0, 0 },        // the base currency
+};
+
+#define RATE_ONE 256        // fixed-point value of one base ticket
 
 void initmlfq();
+void mlfqrebuild();
 void enqueue(int lvl, struct proc *p);
 struct proc* dequeue(int lvl);
-inline struct proc* peek(int lvl) { return mlfq[lvl].queue[mlfq[lvl].head]; };
-inline int isempty(int lvl) { return mlfq[lvl].head > mlfq[lvl].tail; }
+static void unqueue(struct proc *p);
+inline struct proc* peek(int lvl) { return mlfq[lvl].head; };
+inline int isempty(int lvl) { return mlfq[lvl].head == 0; }
 
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
+static void kthreadstart(void);
 
 static void wakeup1(void *chan);
 
+static unsigned long randstate = SEED;
+
 // random number generator lifted off usertests.c and modified to use a range
 static unsigned int
 rand(unsigned int limit)
 {
-  static unsigned long randstate = SEED;
   if (limit == 0) return 0;
   randstate = randstate * 1664525 + 1013904223;
   return randstate % limit;
@@ -49,7 +136,7 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
-  ptable.PromoteAtTime = ticks + TICKS_TO_PROMOTE;
+  ptable.PromoteAtTime = ticks + boostticks;
   initmlfq();
 }
 
@@ -92,9 +179,307 @@ myproc(void) {
   return p;
 }
 
+// Length of an MLFQ budget in TSC cycles.
+static uint64
+quantum(void)
+{
+  return (uint64)mlfqbudget * quantumus * tscmhz;
+}
+
+// Length of p's next time slice in TSC cycles.  An EDF process may
+// run no longer than its remaining budget, and anything else must
+// give way when a throttled EDF process gets its new budget.
+static uint64
+slice(struct proc *p, uint64 now)
+{
+  uint64 len = (uint64)quantumus * tscmhz;
+
+  if(p->period){
+    if(p->edfbudget < len)
+      len = p->edfbudget;
+  } else if(edfnext > now && edfnext - now < len)
+    len = edfnext - now;
+  return len;
+}
+
+// Lottery compensation for a process that ran for used cycles and
+// is moving to state: one that blocks after using a fraction f of
+// its time slice draws with 1/f times its tickets until it next
+// runs, so blocking early does not cost it its share.
+static uint
+compensation(uint64 used, enum procstate state)
+{
+  uint64 q = (uint64)quantumus * tscmhz;
+
+  if(state != SLEEPING || used >= q)
+    return COMP_ONE;
+  if(used * (COMP_MAX / COMP_ONE) <= q)
+    return COMP_MAX;
+  return udiv64(q * COMP_ONE, (uint)used);
+}
+
+// Hash sleeping p on its channel, for wakeup1().
+static void
+sleeplink(struct proc *p)
+{
+  struct proc **pp = &ptable.sleephash[SLEEPHASH(p->chan)];
+
+  p->snext = *pp;
+  if(*pp)
+    (*pp)->sprev = &p->snext;
+  p->sprev = pp;
+  *pp = p;
+}
+
+static void
+sleepunlink(struct proc *p)
+{
+  *p->sprev = p->snext;
+  if(p->snext)
+    p->snext->sprev = p->sprev;
+  p->snext = 0;
+  p->sprev = 0;
+}
+
+static void
+edfswap(struct edfheap *h, int i, int j)
+{
+  struct proc *p = h->p[i];
+
+  h->p[i] = h->p[j];
+  h->p[j] = p;
+  h->p[i]->eslot = i;
+  h->p[j]->eslot = j;
+}
+
+// Move the entry at i of h up or down to its place.
+static void
+edffix(struct edfheap *h, int i)
+{
+  int c;
+
+  while(i > 0 && h->p[i]->deadline < h->p[(i-1)/2]->deadline){
+    edfswap(h, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= h->n)
+      break;
+    if(c+1 < h->n && h->p[c+1]->deadline < h->p[c]->deadline)
+      c++;
+    if(h->p[i]->deadline <= h->p[c]->deadline)
+      break;
+    edfswap(h, i, c);
+    i = c;
+  }
+}
+
+static void
+edfpush(struct edfheap *h, struct proc *p)
+{
+  if(h->n == EDF_MAXUTIL)
+    panic("edfpush");
+  h->p[h->n] = p;
+  p->eheap = h;
+  p->eslot = h->n++;
+  edffix(h, p->eslot);
+}
+
+static void
+edfremove(struct proc *p)
+{
+  struct edfheap *h = p->eheap;
+  int i = p->eslot;
+
+  h->n--;
+  if(i != h->n){
+    h->p[i] = h->p[h->n];
+    h->p[i]->eslot = i;
+    edffix(h, i);
+  }
+  p->eheap = 0;
+}
+
+// Put runnable p on the run queue, or an EDF heap.
+static void
+runlink(struct proc *p)
+{
+  if(p->period){
+    edfpush(p->edfbudget ? &edfready : &edfwait, p);
+    return;
+  }
+  p->rnext = 0;
+  p->rprev = runq.tail;
+  if(runq.tail)
+    runq.tail->rnext = p;
+  else
+    runq.head = p;
+  runq.tail = p;
+  runq.tickets[p->currency] += p->tickets;
+  runq.weight[p->currency] += (uint64)p->tickets * p->comp;
+}
+
+static void
+rununlink(struct proc *p)
+{
+  if(p->period){
+    edfremove(p);
+    return;
+  }
+  if(p->rprev)
+    p->rprev->rnext = p->rnext;
+  else
+    runq.head = p->rnext;
+  if(p->rnext)
+    p->rnext->rprev = p->rprev;
+  else
+    runq.tail = p->rprev;
+  p->rnext = p->rprev = 0;
+  runq.tickets[p->currency] -= p->tickets;
+  runq.weight[p->currency] -= (uint64)p->tickets * p->comp;
+}
+
+// Charge the cycles since p's last change of state to the state
+// it is leaving, then move it to state.
+// Caller must hold ptable.lock (or own p exclusively).
+static void
+setstate(struct proc *p, enum procstate state)
+{
+  uint64 now = rdtsc();
+
+  switch(p->state){
+  case RUNNING:
+    p->rtime += now - p->stamp;
+    if(state == RUNNABLE)
+      tune.preempts++;
+    else if(state == SLEEPING)
+      tune.blocks++;
+    p->comp = compensation(now - p->stamp, state);
+    break;
+  case RUNNABLE:
+    p->wtime += now - p->stamp;
+    if(state == RUNNING && p->woken){
+      tune.resp += now - p->stamp;
+      tune.nresp++;
+    }
+    p->woken = 0;
+    rununlink(p);
+    break;
+  case SLEEPING:
+    p->stime += now - p->stamp;
+    p->woken = state == RUNNABLE;
+    sleepunlink(p);
+    break;
+  default:
+    break;
+  }
+  if(p->state == RUNNING && p->period){
+    if(now - p->stamp < p->edfbudget)
+      p->edfbudget -= now - p->stamp;
+    else
+      p->edfbudget = 0;
+  }
+  p->stamp = now;
+  p->state = state;
+  if(state == SLEEPING)
+    sleeplink(p);
+  if(state == RUNNABLE)
+    runlink(p);
+  if(state == RUNNABLE && p->period)
+    edfkick = 1;
+  if(state == RUNNING)
+    timerslice(slice(p, now));
+}
+
+// Report p's run, wait and sleep cycles, including the time
+// spent so far in its current state.  Caller must hold ptable.lock.
+static void
+cputimes(struct proc *p, uint64 *r, uint64 *w, uint64 *s)
+{
+  uint64 open = rdtsc() - p->stamp;
+
+  *r = p->rtime + (p->state == RUNNING ? open : 0);
+  *w = p->wtime + (p->state == RUNNABLE ? open : 0);
+  *s = p->stime + (p->state == SLEEPING ? open : 0);
+}
+
+// Return the live process with the given pid, or 0.
+// Caller must hold ptable.lock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = ptable.pidhash[PIDHASH(pid)]; p; p = p->hnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Take p out of the pid hash, the process list and its parent's
+// child list, and put it on the free list.
+// Caller must hold ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == p){
+      *pp = p->hnext;
+      break;
+    }
+  }
+  if(p->parent){
+    for(pp = &p->parent->child; *pp; pp = &(*pp)->sibling){
+      if(*pp == p){
+        *pp = p->sibling;
+        break;
+      }
+    }
+  }
+  if(p->prev)
+    p->prev->next = p->next;
+  else
+    ptable.list = p->next;
+  if(p->next)
+    p->next->prev = p->prev;
+  else
+    ptable.tail = p->prev;
+  ptable.nproc--;
+  p->hnext = 0;
+  p->sibling = 0;
+  p->parent = 0;
+  p->pid = 0;
+  p->state = UNUSED;
+  p->prev = 0;
+  p->next = ptable.free;
+  ptable.free = p;
+}
+
+// Carve a page into struct procs for the free list.
+// Returns -1 if out of memory.
+static int
+moreprocs(void)
+{
+  struct proc *p;
+  char *mem;
+
+  if((mem = kalloczero()) == 0)
+    return -1;
+  acquire(&ptable.lock);
+  for(p = (struct proc*)mem; (char*)(p + 1) <= mem + PGSIZE; p++){
+    p->next = ptable.free;
+    ptable.free = p;
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
+// Take a free proc, unless there are maxproc processes
+// already, change its state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
 static struct proc*
@@ -104,31 +489,69 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
+  while(ptable.free == 0 && ptable.nproc < maxproc){
+    release(&ptable.lock);
+    if(moreprocs() < 0)
+      return 0;
+    acquire(&ptable.lock);
+  }
+  if(ptable.nproc >= maxproc){
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->next;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
-
-found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->hnext = ptable.pidhash[PIDHASH(p->pid)];
+  ptable.pidhash[PIDHASH(p->pid)] = p;
+  // Pids only grow, so appending keeps the list in pid order.
+  p->next = 0;
+  p->prev = ptable.tail;
+  if(ptable.tail)
+    ptable.tail->next = p;
+  else
+    ptable.list = p;
+  ptable.tail = p;
+  ptable.nproc++;
+  p->qnext = p->qprev = 0;
+  p->qlevel = -1;
+  p->rnext = p->rprev = 0;
+  p->eheap = 0;
+  p->parent = 0;
+  p->child = 0;
+  p->sibling = 0;
   p->ticks = 0;
+  p->stamp = rdtsc();
+  p->rtime = p->wtime = p->stime = 0;
 #ifdef F_BENCH
   p->childticks = 0;
   p->children = 0;
+  p->childrtime = p->childwtime = p->childstime = 0;
 #endif
-  p->priority = MAXPRIORITY;
-  p->budget = DEFAULT_BUDGET;
+  p->priority = maxprio;
+  p->budget = quantum();
+  p->woken = 0;
+  p->period = 0;              // children never inherit EDF
+  p->edfutil = 0;
+  p->inherit = -1;
+  p->held = 0;
+  p->blockedon = 0;
+  p->wnext = 0;
+  p->locktime = 0;
   p->tickets = INIT_TICKETS;
+  p->currency = 0;
+  p->comp = COMP_ONE;
+  p->aio = 0;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -183,7 +606,7 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  setstate(p, RUNNABLE);
   enqueue(p->priority, p);
 
   release(&ptable.lock);
@@ -198,6 +621,8 @@ growproc(int n)
   struct proc *curproc = myproc();
 
   sz = curproc->sz;
+  if(n < 0 && aiobusy(curproc))
+    return -1;    // an I/O worker may be copying to those pages
   if(n > 0){
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -229,11 +654,12 @@ fork(void)
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = curproc->sz;
-  np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
@@ -243,6 +669,12 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->exe){
+    np->exe = idup(curproc->exe);
+    itext(np->exe, 1);
+  }
+  np->nseg = curproc->nseg;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -250,8 +682,13 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  np->parent = curproc;
+  np->sibling = curproc->child;
+  curproc->child = np;
   np->tickets = curproc->tickets;
+  np->currency = curproc->currency;
+  setstate(np, RUNNABLE);
+  trace(TR_FORK, curproc->pid, np->pid);
   enqueue(np->priority, np);
 
   release(&ptable.lock);
@@ -259,6 +696,43 @@ fork(void)
   return pid;
 }
 
+// Start a kernel thread running fn(arg), which must never return.
+// It has no user memory, shares the caller's current directory,
+// and is a child of init.
+struct proc*
+kthread(char *name, void (*fn)(void*), void *arg)
+{
+  struct proc *np;
+
+  if((np = allocproc()) == 0)
+    return 0;
+  if((np->pgdir = setupkvm()) == 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return 0;
+  }
+  np->sz = 0;
+  np->nseg = 0;
+  np->kfn = fn;
+  np->karg = arg;
+  np->context->eip = (uint)kthreadstart;
+  np->cwd = idup(myproc()->cwd);
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  acquire(&ptable.lock);
+  np->parent = initproc;
+  np->sibling = initproc->child;
+  initproc->child = np;
+  setstate(np, RUNNABLE);
+  enqueue(np->priority, np);
+  release(&ptable.lock);
+
+  return np;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -272,6 +746,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  aiofree(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -282,8 +758,13 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe){
+    itext(curproc->exe, -1);
+    iput(curproc->exe);
+  }
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
 
   acquire(&ptable.lock);
 
@@ -291,16 +772,26 @@ exit(void)
   wakeup1(curproc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == curproc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
-    }
+  while((p = curproc->child) != 0){
+    curproc->child = p->sibling;
+    p->parent = initproc;
+    p->sibling = initproc->child;
+    initproc->child = p;
+    if(p->state == ZOMBIE)
+      wakeup1(initproc);
+  }
+
+  // Give back any EDF reservation.
+  if(curproc->period){
+    ptable.nedf--;
+    ptable.edfutil -= curproc->edfutil;
+    curproc->period = 0;
+    curproc->edfutil = 0;
   }
 
   // Jump into the scheduler, never to return.
-  curproc->state = ZOMBIE;
+  setstate(curproc, ZOMBIE);
+  trace(TR_EXIT, curproc->pid, 0);
   sched();
   panic("zombie exit");
 }
@@ -316,16 +807,17 @@ wait(void)
   
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through children looking for exited ones.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
+    for(p = curproc->child; p; p = p->sibling){
       havekids = 1;
       if(p->state == ZOMBIE){
 #ifdef F_BENCH
         curproc->childticks += p->ticks;
         curproc->children += 1;
+        curproc->childrtime += p->rtime;
+        curproc->childwtime += p->wtime;
+        curproc->childstime += p->stime;
         p->children = 0;
         p->childticks = 0;
 #endif
@@ -334,13 +826,12 @@ wait(void)
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
         p->name[0] = 0;
         p->killed = 0;
         p->tickets = 0;
+        p->currency = 0;
         p->ticks = 0;
-        p->state = UNUSED;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -357,10 +848,336 @@ wait(void)
   }
 }
 
+// Earliest-deadline-first class.
+//
+// A process that calls setdeadline() reserves runtime cycles of
+// CPU in every period, and every scheduler runs such processes
+// ahead of its own, most urgent deadline first.  Admission
+// control keeps the total reservation within EDF_MAXUTIL of a
+// single CPU, which EDF can always meet; the extra CPUs of a
+// multiprocessor only add slack.  A process that uses up its
+// budget is throttled until its next period begins.
+
+// Return the eligible EDF process with the earliest deadline, or 0,
+// starting new periods that are due.  Caller must hold ptable.lock.
+static struct proc*
+edfpick(void)
+{
+  struct proc *p, *best;
+  uint64 now;
+
+  now = rdtsc();
+  while(edfwait.n && now >= (p = edfwait.p[0])->deadline){
+    edfremove(p);
+    p->deadline = now + p->period;
+    p->edfbudget = p->runtime;
+    edfpush(&edfready, p);
+  }
+  while(edfready.n && now >= (p = edfready.p[0])->deadline){
+    p->deadline = now + p->period;
+    p->edfbudget = p->runtime;
+    edffix(&edfready, 0);
+  }
+  edfnext = edfwait.n ? edfwait.p[0]->deadline : 0;
+  best = edfready.n ? edfready.p[0] : 0;
+  if(best == 0)
+    edfkick = 0;
+  return best;
+}
+
+// Run the most urgent EDF process on c, if there is one.
+// Caller must hold ptable.lock.
+static void
+edfdispatch(struct cpu *c)
+{
+  struct proc *p;
+
+  if(ptable.nedf == 0 || (p = edfpick()) == 0)
+    return;
+
+  c->proc = p;
+  switchuvm(p);
+  setstate(p, RUNNING);
+  p->ticks++;
+  trace(TR_SWITCHIN, p->pid, p->priority);
+
+  swtch(&(c->scheduler), p->context);
+  switchkvm();
+  trace(TR_SWITCHOUT, p->pid, p->state);
+
+  // It may have left the EDF class while running.
+  if(p->state == RUNNABLE && p->period == 0)
+    enqueue(p->priority, p);
+  c->proc = 0;
+}
+
+// Should the timer interrupt preempt the current process in
+// favour of a waiting EDF process?
+int
+edfpreempt(void)
+{
+  return edfkick && myproc()->period == 0;
+}
+
+// Put the current process in the EDF class with the given period
+// and runtime in microseconds, or take it out if both are 0.
+// Fails if the new reservation would overload the CPU.
+int
+setdeadline(uint period, uint runtime)
+{
+  struct proc *p = myproc();
+  uint util;
+
+  if(period == 0 && runtime == 0)
+    util = 0;
+  else if(runtime == 0 || runtime > period)
+    return -1;
+  else
+    util = udiv64((uint64)runtime * 1000 + period - 1, period);
+
+  acquire(&ptable.lock);
+  if(ptable.edfutil - p->edfutil + util > EDF_MAXUTIL){
+    release(&ptable.lock);
+    return -1;
+  }
+  ptable.edfutil = ptable.edfutil - p->edfutil + util;
+  if(p->period)
+    ptable.nedf--;
+  if(util){
+    ptable.nedf++;
+    p->period = (uint64)period * tscmhz;
+    p->runtime = (uint64)runtime * tscmhz;
+    p->deadline = rdtsc() + p->period;
+    p->edfbudget = p->runtime;
+    timerslice(slice(p, rdtsc()));
+  } else
+    p->period = 0;
+  p->edfutil = util;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Priority inheritance for sleeplocks.
+//
+// A process holding sleeplocks runs at the highest MLFQ priority
+// of any process waiting for one of them, and passes that on if
+// it is itself waiting for a lock.  The inherited priority is
+// kept in p->inherit, apart from p->priority, so that MLFQ
+// demotion and boosting still act on the process's own level;
+// enqueue() uses whichever is higher.
+//
+// Each lock lists the processes blocked on it (lk->waiters, through
+// wnext), and only a lock with waiters is on its owner's held list,
+// so an owner's inherited priority comes from just the processes
+// actually waiting for it.  The waiter and held lists and blockedon
+// are protected by ptable.lock, and every change to a lock's
+// waiters also holds its lk->lk.  So a process taking or releasing
+// a lock nobody waits for sees that under lk->lk and skips
+// ptable.lock altogether.
+
+static int
+effprio(struct proc *p)
+{
+  return p->inherit > p->priority ? p->inherit : p->priority;
+}
+
+// Highest priority among processes waiting for a lock p holds, or -1.
+static int
+waiterprio(struct proc *p)
+{
+  struct sleeplock *lk;
+  struct proc *q;
+  int prio;
+
+  prio = -1;
+  for(lk = p->held; lk; lk = lk->nextheld)
+    for(q = lk->waiters; q; q = q->wnext)
+      if(effprio(q) > prio)
+        prio = effprio(q);
+  return prio;
+}
+
+// Recompute p's inherited priority, requeue it if that changed its
+// level, and carry the change along the chain of lock owners.
+// Caller must hold ptable.lock.
+static void
+reinherit(struct proc *p)
+{
+  int old, depth;
+
+  for(depth = 0; p && depth < MAXPROC; depth++){
+    old = effprio(p);
+    p->inherit = waiterprio(p);
+    if(effprio(p) == old)
+      break;
+    trace(TR_PRIO, p->pid, effprio(p));
+    if(p->state == RUNNABLE){
+      unqueue(p);
+      enqueue(p->priority, p);
+    }
+    p = p->blockedon ? p->blockedon->owner : 0;
+  }
+}
+
+// Add lk to p's held list.  Caller must hold ptable.lock.
+static void
+heldlink(struct proc *p, struct sleeplock *lk)
+{
+  lk->nextheld = p->held;
+  p->held = lk;
+}
+
+static void
+heldunlink(struct proc *p, struct sleeplock *lk)
+{
+  struct sleeplock **pp;
+
+  for(pp = &p->held; *pp; pp = &(*pp)->nextheld){
+    if(*pp == lk){
+      *pp = lk->nextheld;
+      break;
+    }
+  }
+  lk->nextheld = 0;
+}
+
+// The current process is about to sleep waiting for lk, which is
+// held.  Caller must hold lk->lk.
+void
+inheritblock(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+
+  if(p->blockedon == lk)
+    return;   // woken, but lost the lock again
+  acquire(&ptable.lock);
+  p->blockedon = lk;
+  if(lk->waiters == 0 && lk->owner)
+    heldlink(lk->owner, lk);
+  p->wnext = lk->waiters;
+  lk->waiters = p;
+  if(lk->owner)
+    reinherit(lk->owner);
+  release(&ptable.lock);
+}
+
+// The current process has acquired lk.  Caller must hold lk->lk.
+void
+inherithold(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+  struct proc **pp;
+
+  lk->owner = p;
+  if(p->blockedon != lk && lk->waiters == 0)
+    return;
+  acquire(&ptable.lock);
+  if(p->blockedon == lk){
+    for(pp = &lk->waiters; *pp; pp = &(*pp)->wnext){
+      if(*pp == p){
+        *pp = p->wnext;
+        break;
+      }
+    }
+    p->wnext = 0;
+    p->blockedon = 0;
+  }
+  // Processes still waiting for lk now wait for p.
+  if(lk->waiters){
+    heldlink(p, lk);
+    reinherit(p);
+  }
+  release(&ptable.lock);
+}
+
+// The current process is releasing lk.  Caller must hold lk->lk.
+void
+inheritdrop(struct sleeplock *lk)
+{
+  struct proc *p = myproc();
+
+  lk->owner = 0;
+  if(lk->waiters == 0)
+    return;
+  acquire(&ptable.lock);
+  heldunlink(p, lk);
+  reinherit(p);
+  release(&ptable.lock);
+}
+
+// Set the scheduling policy.  Processes keep running; the MLFQ
+// queues are rebuilt from whatever is runnable.
+void
+setscheduler(int s)
+{
+  acquire(&ptable.lock);
+  SCHEDULER = s;
+  mlfqrebuild();
+  release(&ptable.lock);
+}
+
+// Set the highest MLFQ priority, lowering anyone above it.
+void
+setmaxprio(int m)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  maxprio = m;
+  for(p = ptable.list; p; p = p->next){
+    if(p->priority > m)
+      p->priority = m;
+    if(p->inherit > m)
+      p->inherit = m;
+  }
+  mlfqrebuild();
+  release(&ptable.lock);
+}
+
+// Restart the lottery's random number sequence.
+void
+setseed(int s)
+{
+  randseed = s;
+  randstate = s;
+}
+
+// Adjust the MLFQ time slice and boost interval from the last
+// interval's statistics.  While processes woken from sleep wait
+// longer than resptarget to run, shorten both; otherwise, while
+// most slices run out, the load is CPU-bound and switching less
+// often raises throughput, so lengthen both.
+// Caller must hold ptable.lock.
+static void
+autotuner(void)
+{
+  uint resp;
+
+  resp = tune.nresp ? (uint)tsc2us(udiv64(tune.resp, tune.nresp)) : 0;
+  if(tune.nresp && resp > resptarget){
+    quantumus = quantumus * 3 / 4;
+    if(quantumus < TUNE_MINQ_US)
+      quantumus = TUNE_MINQ_US;
+    boostticks = boostticks * 3 / 4;
+    if(boostticks < 1)
+      boostticks = 1;
+  } else if(tune.preempts > 2 * tune.blocks){
+    quantumus = quantumus * 5 / 4;
+    if(quantumus > TUNE_MAXQ_US)
+      quantumus = TUNE_MAXQ_US;
+    boostticks = (boostticks * 5 + 3) / 4;
+    if(boostticks > TUNE_MAXBOOST)
+      boostticks = TUNE_MAXBOOST;
+  }
+  tune.resp = 0;
+  tune.nresp = tune.preempts = tune.blocks = 0;
+  tune.next = ticks + TUNE_TICKS;
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
-// Scheduler never returns.  It loops, doing:
+// Scheduler returns only when the policy changes.  It loops, doing:
 //  - choose a process to run
 //  - swtch to start running that process
 //  - eventually that process transfers control
@@ -372,33 +1189,41 @@ scheduler(void)
   struct cpu *c = mycpu();
   c->proc = 0;
   
-  for(;;){
+  while(SCHEDULER == S_BASIC){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    // Run the process at the head of the run queue; it goes to
+    // the back when it is next runnable.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
+    edfdispatch(c);
+    p = SCHEDULER == S_BASIC ? runq.head : 0;
+    if(p){
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
       switchuvm(p);
-      p->state = RUNNING;
+      setstate(p, RUNNING);
       p->ticks++;
+      trace(TR_SWITCHIN, p->pid, p->priority);
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
+      trace(TR_SWITCHOUT, p->pid, p->state);
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
+      // If the policy became MLFQ meanwhile, queue it.
+      if(p->state == RUNNABLE)
+        enqueue(p->priority, p);
       c->proc = 0;
     }
     release(&ptable.lock);
 
+    // Nothing to run: zero a page for kalloczero().
+    if(!p)
+      kzero();
   }
 }
 
@@ -407,6 +1232,8 @@ scheduler_mlfq(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  uint64 start, used;
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -415,34 +1242,49 @@ scheduler_mlfq(void)
     // Enable interrupts on this processor.
     sti();
     acquire(&ptable.lock);
+    if (SCHEDULER != S_MLFQ)
+    {
+      release(&ptable.lock);
+      return;
+    }
+    edfdispatch(c);
 
     // Find the highest priority non-empty queue, and remove the first element
-    for (int i = MAXPRIORITY; i >= 0; i--)
+    for (int i = maxprio; i >= 0; i--)
     {
       if (isempty(i)) continue;
       p = dequeue(i);
       break;
     }
 
+    ran = p != 0;
     if (p)
     {
       c->proc = p;
       switchuvm(p);
-      p->state = RUNNING;
+      setstate(p, RUNNING);
       p->ticks++;
-      p->scheduledAtTime = ticks;
+      start = p->rtime;
+      trace(TR_SWITCHIN, p->pid, p->priority);
 
       swtch(&(c->scheduler), p->context);
 
-      // Process is done running for now
+      // Process is done running for now.  Charge it for the
+      // cycles it actually ran, as recorded by setstate().
       switchkvm();
-      p->budget -= ticks - p->scheduledAtTime;
+      used = p->rtime - start;
+      trace(TR_SWITCHOUT, p->pid, p->state);
 
-      if (p->budget <= 0)
+      if (used >= p->budget)
       {
-        p->budget = DEFAULT_BUDGET;
-        if (p->priority != 0) p->priority--;
+        p->budget = quantum();
+        if (p->priority != 0)
+        {
+          p->priority--;
+          trace(TR_PRIO, p->pid, p->priority);
+        }
       }
+      else p->budget -= used;
 
       if (p->state == RUNNABLE)
       {
@@ -452,77 +1294,158 @@ scheduler_mlfq(void)
       c->proc = 0;
     }
 
+    if (autotune && ticks >= tune.next) autotuner();
+
     if (ticks >= ptable.PromoteAtTime)
     {
-      ptable.PromoteAtTime = ticks + TICKS_TO_PROMOTE;
+      ptable.PromoteAtTime = ticks + boostticks;
       
-      // Clear all queues, except the toplevel queue
-      for (int i = 0; i < MAXPRIORITY; i++)
-      {
-        struct pqueue *q = &mlfq[i];
-        q->head = 0;
-        q->tail = -1;
-      }
-
-      // Increment (almost) all process priorities, and re-insert runnable programs
-      for (int i = 0; i < NPROC; i++)
+      // Increment (almost) all process priorities, and move runnable
+      // programs to the queue for their new level
+      int promoted = 0;
+      for (p = ptable.list; p; p = p->next)
       {
-        p = &ptable.proc[i];
-        p->budget = DEFAULT_BUDGET;
-        if (p->state == UNUSED || p->priority == MAXPRIORITY) continue;
-        if (p->state != ZOMBIE) p->priority++;
+        p->budget = quantum();
+        if (p->state == UNUSED || p->priority == maxprio) continue;
+        if (p->state != ZOMBIE)
+        {
+          p->priority++;
+          promoted++;
+        }
         if (p->state == RUNNABLE) enqueue(p->priority, p);
       }
+      trace(TR_BOOST, 0, promoted);
     }
     
     release(&ptable.lock);
+
+    // Nothing to run: zero a page for kalloczero().
+    if (!ran) kzero();
   }
 }
 
+// rate base tickets apiece for weight tickets, saturating at 2^58
+// so that NCURRENCY of them still add up.
+static uint64
+lvalue(uint64 rate, uint64 weight)
+{
+  int sh;
+
+  for (sh = 0; weight >> 30; sh++) weight >>= 1;
+  rate *= weight;   // rate is at most 2^32
+  for (; sh > 0 && !(rate >> 57); sh--) rate <<= 1;
+  if (sh || rate >> 58) return 1ULL << 58;
+  return rate;
+}
+
+// A random number below n, to within rand()'s 30 bits.
+static uint64
+draw(uint64 n)
+{
+  int shift;
+
+  for (shift = 0; (n >> shift) >= 0x40000000; shift++)
+    ;
+  return (uint64)rand((uint)(n >> shift)) << shift;
+}
+
+// Draw the lottery from the run queue: a currency, with chance in
+// proportion to the value of its runnable tickets in base tickets,
+// compensation included, then one of its processes in proportion
+// to its share of them.  Returns 0 if nothing is runnable.
+// Caller must hold ptable.lock.
+static struct proc*
+lotterydraw(void)
+{
+  uint64 active[NCURRENCY], rate[NCURRENCY], value[NCURRENCY], total, sum;
+  struct proc *p;
+  int c;
+
+  if (runq.head == 0) return 0;
+  for (c = 0; c < NCURRENCY; c++) active[c] = runq.tickets[c];
+
+  // A currency with active tickets makes its funding active in
+  // its parent.
+  for (c = NCURRENCY - 1; c > 0; c--)
+    if (currencies[c].used && active[c]) active[currencies[c].parent] += currencies[c].funding;
+
+  // Base tickets per ticket of each currency.
+  rate[0] = RATE_ONE;
+  for (c = 1; c < NCURRENCY; c++)
+  {
+    rate[c] = 0;
+    if (currencies[c].used && active[c] && active[currencies[c].parent])
+    {
+      rate[c] = udiv64(rate[currencies[c].parent] * currencies[c].funding,
+                       active[c] >> 32 ? 0xffffffff : (uint)active[c]);
+      if (rate[c] >> 32) rate[c] = 0xffffffff;
+    }
+  }
+
+  total = 0;
+  for (c = 0; c < NCURRENCY; c++)
+  {
+    value[c] = lvalue(rate[c], runq.weight[c]);
+    total += value[c];
+  }
+  // Every runnable ticket is worthless: take turns.
+  if (total == 0) return runq.head;
+
+  sum = draw(total);
+  for (c = 0; sum >= value[c]; c++) sum -= value[c];
+
+  total = draw(runq.weight[c]);
+  sum = 0;
+  for (p = runq.head; p; p = p->rnext)
+  {
+    if (p->currency != c) continue;
+    sum += (uint64)p->tickets * p->comp;
+    if (sum > total) return p;
+  }
+  panic("lotterydraw");
+}
+
 void
 scheduler_lottery(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  uint winner, sum, ticketcount;
 
   c->proc = 0;
 
   for (;;)
   {
-    ticketcount = 0;
-
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) ticketcount += p->tickets * (p->state == RUNNABLE);
-    winner = rand(ticketcount) + 1; 
-    sum = 0;
-
     sti();
     acquire(&ptable.lock);
-    if (ticketcount) 
-    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if (SCHEDULER != S_LOTTERY)
     {
-      if (p->state != RUNNABLE) continue;
+      release(&ptable.lock);
+      return;
+    }
+    edfdispatch(c);
 
-      sum += p->tickets;
-      
-      if (sum >= winner)
-      {
-        c->proc = p;
-        switchuvm(p);
-        p->state = RUNNING;
-        p->ticks++;
-
-        swtch(&(c->scheduler), p->context);
-        
-        // Process is done running
-        switchkvm();
-        break;
-      }
+    if ((p = lotterydraw()) != 0)
+    {
+      c->proc = p;
+      switchuvm(p);
+      setstate(p, RUNNING);
+      p->ticks++;
+      trace(TR_SWITCHIN, p->pid, p->priority);
+
+      swtch(&(c->scheduler), p->context);
+
+      // Process is done running
+      switchkvm();
+      trace(TR_SWITCHOUT, p->pid, p->state);
+      if (p->state == RUNNABLE) enqueue(p->priority, p);
     }
 
     release(&ptable.lock);
 
     c->proc = 0;
+
+    // Nothing to run: zero a page for kalloczero().
+    if (!p) kzero();
   }
 }
 
@@ -559,7 +1482,7 @@ yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
   struct proc *p = myproc();
-  p->state = RUNNABLE;
+  setstate(p, RUNNABLE);
   sched();
   release(&ptable.lock);
 }
@@ -585,6 +1508,19 @@ forkret(void)
   // Return to "caller", actually trapret (see allocproc).
 }
 
+// A new kernel thread's first scheduling by scheduler()
+// will swtch here.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -610,7 +1546,7 @@ sleep(void *chan, struct spinlock *lk)
   }
   // Go to sleep.
   p->chan = chan;
-  p->state = SLEEPING;
+  setstate(p, SLEEPING);
 
   sched();
 
@@ -630,14 +1566,17 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *next;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+  for(p = ptable.sleephash[SLEEPHASH(chan)]; p; p = next){
+    next = p->snext;
+    if(p->chan == chan)
     {
-      p->state = RUNNABLE;
+      setstate(p, RUNNABLE);
+      trace(TR_WAKEUP, p->pid, p->priority);
       enqueue(p->priority, p);
     }
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -658,18 +1597,17 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-      {
-        p->state = RUNNABLE;
-        enqueue(p->priority, p);
-      }
-      release(&ptable.lock);
-      return 0;
+  if((p = findproc(pid)) != 0){
+    p->killed = 1;
+    // Wake process from sleep if necessary.
+    if(p->state == SLEEPING)
+    {
+      setstate(p, RUNNABLE);
+      trace(TR_WAKEUP, p->pid, p->priority);
+      enqueue(p->priority, p);
     }
+    release(&ptable.lock);
+    return 0;
   }
   release(&ptable.lock);
   return -1;
@@ -694,8 +1632,9 @@ procdump(void)
   struct proc *p;
   char *state;
   uint pc[10];
+  struct sleeplock *lk;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  for(p = ptable.list; p; p = p->next){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -708,6 +1647,13 @@ procdump(void)
       for(i=0; i<10 && pc[i] != 0; i++)
         cprintf(" %p", pc[i]);
     }
+    if(p->blockedon){
+      lk = p->blockedon;
+      cprintf(" [%s held by %d; %d waits, max %d us]", lk->name, lk->pid,
+              lk->nwait, (uint)tsc2us(lk->maxwait));
+    }
+    if(p->inherit > p->priority)
+      cprintf(" [inherits %d]", p->inherit);
     cprintf("\n");
   }
 }
@@ -720,13 +1666,11 @@ setpriority(int pid, int priority)
   int code = -1;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid) {
-        p->priority = priority;
-        p->budget = DEFAULT_BUDGET;
-        code = 0;
-        break;
-    }
+  if((p = findproc(pid)) != 0) {
+      p->priority = priority;
+      p->budget = quantum();
+      trace(TR_PRIO, p->pid, priority);
+      code = 0;
   }
   release(&ptable.lock);
   
@@ -740,11 +1684,9 @@ getpriority(int pid)
     struct proc *p;
 
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(p->pid == pid && p->state != UNUSED) {
-            release(&ptable.lock);
-            return p->priority;
-        }
+    if((p = findproc(pid)) != 0) {
+        release(&ptable.lock);
+        return p->priority;
     }
     release(&ptable.lock);
     return -1;
@@ -754,36 +1696,92 @@ int
 settickets(int tickets)
 {
   acquire(&ptable.lock);
-  uint pid = myproc()->pid;
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  myproc()->tickets = tickets;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Manage lottery currencies; see currency.h.
+int
+tickctl(int op, int a, int b)
+{
+  struct proc *p;
+  int c, r;
+
+  if (a < 0 || a >= NCURRENCY || !currencies[a].used || b < 0) return -1;
+
+  r = -1;
+  acquire(&ptable.lock);
+  switch (op)
   {
-    if (p->pid == pid)
+  case TC_CREATE:
+    // Above its parent, so lotterydraw() sees children first.
+    for (c = a + 1; c < NCURRENCY; c++)
     {
-      p->tickets = tickets;
-      release(&ptable.lock);
-      return 0;
+      if (!currencies[c].used)
+      {
+        currencies[c].used = 1;
+        currencies[c].parent = a;
+        currencies[c].funding = b;
+        r = c;
+        break;
+      }
     }
+    break;
+  case TC_JOIN:
+    if (b < 1) break;
+    myproc()->currency = a;
+    myproc()->tickets = b;
+    r = 0;
+    break;
+  case TC_FUND:
+    if (a == 0) break;
+    currencies[a].funding = b;
+    r = 0;
+    break;
+  case TC_DESTROY:
+    if (a == 0) break;
+    for (c = 1; c < NCURRENCY; c++)
+      if (currencies[c].used && currencies[c].parent == a) goto out;
+    for (p = ptable.list; p; p = p->next)
+      if (p->state != UNUSED && p->currency == a) goto out;
+    currencies[a].used = 0;
+    r = 0;
+    break;
   }
+out:
   release(&ptable.lock);
-  return -1;
+  return r;
 }
 
+// Report on up to NPSTAT processes, the lowest pids from pid up.
+// Returns how many; see pstat.h.
 int
-getpinfo(struct pstat *stataddr)
+getpinfo(struct pstat *stataddr, int pid)
 {
+  uint64 r, w, s;
+  int ind;
+
   acquire(&ptable.lock);
 
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+  ind = 0;
+  for (struct proc *p = ptable.list; p && ind < NPSTAT; p = p->next)
   {
-    uint ind = p - ptable.proc;
-    stataddr->inuse[ind] = p->state != UNUSED;
+    if (p->pid < pid) continue;
     stataddr->pid[ind] = p->pid;
     stataddr->tickets[ind] = p->tickets;
+    stataddr->currency[ind] = p->currency;
     stataddr->ticks[ind] = p->ticks;
+    cputimes(p, &r, &w, &s);
+    stataddr->rtime[ind] = tsc2us(r);
+    stataddr->wtime[ind] = tsc2us(w);
+    stataddr->stime[ind] = tsc2us(s);
+    stataddr->locktime[ind] = tsc2us(p->locktime);
+    ind++;
   }
 
   release(&ptable.lock);
-  return 0;
+  return ind;
 }
 
 int
@@ -791,19 +1789,17 @@ benchinfo(struct benchinfo *bench)
 {
 
 #ifdef F_BENCH
+  struct proc *p = myproc();
+
   acquire(&ptable.lock);
-  uint pid = myproc()->pid;
-  for (struct proc *p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-  {
-    if (p->pid == pid)
-    {
-      bench->children = p->children;
-      bench->childticks = p->childticks;
-      release(&ptable.lock);
-      return 0;
-    }
-  }
+  bench->children = p->children;
+  bench->childticks = p->childticks;
+  bench->childrtime = tsc2us(p->childrtime);
+  bench->childwtime = tsc2us(p->childwtime);
+  bench->childstime = tsc2us(p->childstime);
+  bench->scheduler = SCHEDULER;
   release(&ptable.lock);
+  return 0;
 #endif
   
   return -1;
@@ -811,34 +1807,55 @@ benchinfo(struct benchinfo *bench)
 
 // MLFQ data structure code
 
+// Empty the queues.
 void initmlfq()
 {
-  for (int i = 0; i <= MAXPRIORITY; i++)
+  struct proc *p;
+
+  for (int i = 0; i < NPRIO; i++)
+  {
+    while ((p = mlfq[i].head) != 0)
+    {
+      mlfq[i].head = p->qnext;
+      p->qnext = p->qprev = 0;
+      p->qlevel = -1;
+    }
+    mlfq[i].tail = 0;
+  }
+}
+
+// Empty the queues and, under MLFQ, refill them with every runnable
+// process, after a change of policy or levels.
+void mlfqrebuild()
+{
+  if (!holding(&ptable.lock)) panic("mlfqrebuild with no lock");
+  initmlfq();
+  for (struct proc *p = ptable.list; p; p = p->next)
   {
-    mlfq[i].head = 0;
-    mlfq[i].tail = -1;
+    if (p->state == RUNNABLE) enqueue(p->priority, p);
   }
 }
 
+// Append p to the queue for level, moving it there if it is on
+// another already.
 void enqueue(int level, struct proc *p)
 {
-  if (SCHEDULER != S_MLFQ) return;
+  if (SCHEDULER != S_MLFQ || p->period) return;
+
+  // A lock holder runs at its highest waiter's level.
+  if (p->inherit > level) level = p->inherit;
 
   struct pqueue *lqueue = &mlfq[level];
 
   if (!holding(&ptable.lock)) panic("enqueue with no lock");
-  if (lqueue->tail == NPROC - 1)
-  {
-    uint size = lqueue->tail - lqueue->head + 1;
-    if (size == NPROC) panic("MLFQ overflow");
-
-    memmove(lqueue->queue, lqueue->queue + lqueue->head, size * sizeof(*lqueue->queue));
-
-    lqueue->head = 0;
-    lqueue->tail = size - 1;
-  }
-
-  lqueue->queue[++lqueue->tail] = p;
+  unqueue(p);
+
+  p->qnext = 0;
+  p->qprev = lqueue->tail;
+  if (lqueue->tail) lqueue->tail->qnext = p;
+  else lqueue->head = p;
+  lqueue->tail = p;
+  p->qlevel = level;
 }
 
 struct proc* dequeue(int level)
@@ -846,16 +1863,25 @@ struct proc* dequeue(int level)
   struct pqueue *lqueue = &mlfq[level];
 
   if (!holding(&ptable.lock)) panic("dequeue with no lock");
-  if (lqueue->head > lqueue->tail) panic("MLFQ underflow");
+  if (lqueue->head == 0) panic("MLFQ underflow");
 
-  struct proc *p = lqueue->queue[lqueue->head];
-  lqueue->queue[lqueue->head] = 0;
-
-  if (++lqueue->head == NPROC)
-  {
-    lqueue->head = 0;
-    lqueue->tail = -1;
-  }
+  struct proc *p = lqueue->head;
+  unqueue(p);
 
   return p;
-}
\ No newline at end of file
+}
+
+// Remove p from whichever queue it is on, if any.
+static void unqueue(struct proc *p)
+{
+  if (SCHEDULER != S_MLFQ || p->qlevel < 0) return;
+
+  struct pqueue *lqueue = &mlfq[p->qlevel];
+
+  if (p->qprev) p->qprev->qnext = p->qnext;
+  else lqueue->head = p->qnext;
+  if (p->qnext) p->qnext->qprev = p->qprev;
+  else lqueue->tail = p->qprev;
+  p->qnext = p->qprev = 0;
+  p->qlevel = -1;
+}
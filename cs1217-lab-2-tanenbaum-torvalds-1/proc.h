@@ -1,7 +1,19 @@
-#define DEFAULT_BUDGET 3
+// Boot-time values of the scheduler tunables; see sysctl.c.
+#define DEFAULT_BUDGET 3      // MLFQ budget, in time slices
 #define MAXPRIORITY 2
 #define INIT_TICKETS 1
+#define COMP_ONE 16           // lottery compensation fixed point
+#define COMP_MAX (64*COMP_ONE)
 #define TICKS_TO_PROMOTE 30
+#define EDF_MAXUTIL 900       // EDF admission limit, per-mille of one CPU
+#define NPRIO 8               // MLFQ levels; maxprio must stay below
+
+// MLFQ auto-tuner (CTL_AUTOTUNE) limits
+#define TUNE_TICKS 100        // ticks between adjustments
+#define TUNE_RESP_US 5000     // default target wakeup-to-run latency
+#define TUNE_MINQ_US 1000     // shortest time slice it will choose
+#define TUNE_MAXQ_US 100000   // longest time slice it will choose
+#define TUNE_MAXBOOST 1000    // longest boost interval, in ticks
 
 // Set seed for ease of testing, more robust solutions should
 // vary seeds and use better rng-algorithms
@@ -21,6 +33,9 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint64 nexttick;             // rdtsc() due at the next clock tick
+  uint64 sliceend;             // rdtsc() at which proc's time slice ends
+  uint64 nextsample;           // rdtsc() due at the next profiler sample
 };
 
 extern struct cpu cpus[NCPU];
@@ -45,6 +60,16 @@ struct context {
   uint eip;
 };
 
+// A loadable program segment, whose pages exec() leaves unmapped
+// for loadfault() to read in on first touch.
+struct seg {
+  uint va;                     // Page-aligned start address
+  uint memsz;                  // Size in memory
+  uint off;                    // Offset in the program file
+  uint filesz;                 // Bytes from the file; the rest is zero
+  int writable;
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -55,21 +80,60 @@ struct proc {
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *child;          // First child, linked through sibling
+  struct proc *sibling;        // Next child of the same parent
+  struct proc *hnext;          // Next in pid hash chain
+  struct proc *next;           // Next in the process list, or free list
+  struct proc *prev;           // Previous in the process list
+  struct proc *snext;          // Next in the sleep hash chain of chan
+  struct proc **sprev;         // What points to this one in that chain
+  struct proc *qnext;          // Next in its MLFQ queue
+  struct proc *qprev;          // Previous in its MLFQ queue
+  int qlevel;                  // MLFQ queue it is on, or -1
+  struct proc *rnext;          // Next in the run queue
+  struct proc *rprev;          // Previous in the run queue
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Program file, for loadfault()
+  struct seg seg[NSEG];        // Its loadable segments
+  int nseg;
+  struct aioctx *aio;           // Asynchronous I/O ring, if any
+  void (*kfn)(void*);          // Kernel thread body, see kthread()
+  void *karg;
   char name[16];               // Process name (debugging)
   int priority;                // Priority for MLFQ
-  int budget;                  // Budget for MLFQ
+  uint64 budget;               // TSC cycles left in MLFQ quantum
   uint tickets;                // ticket count for lottery scheduling
+  int currency;                // currency the tickets are in
+  uint comp;                   // compensation factor, COMP_ONE is 1x
   uint ticks;                  // counter for number of times this process has been scheduled
-  uint scheduledAtTime;        // time at which this process was last scheduled
+  uint64 stamp;                // rdtsc() at the last change of state
+  uint64 rtime;                // TSC cycles spent RUNNING
+  uint64 wtime;                // TSC cycles spent RUNNABLE
+  uint64 stime;                // TSC cycles spent SLEEPING
+  uint64 period;               // EDF period in TSC cycles, 0 if not EDF
+  uint64 runtime;              // EDF CPU budget per period
+  uint64 deadline;             // end of the current EDF period
+  uint64 edfbudget;            // cycles left in the current EDF period
+  uint edfutil;                // per-mille of a CPU reserved by EDF
+  struct edfheap *eheap;       // EDF heap it is on while runnable
+  int eslot;                   // and its index there
+  int inherit;                 // MLFQ priority inherited from lock waiters, or -1
+  struct sleeplock *held;      // sleeplocks held, for priority inheritance
+  struct sleeplock *blockedon; // sleeplock being waited for
+  struct proc *wnext;          // Next process waiting for it
+  uint64 locktime;             // TSC cycles spent waiting for sleeplocks
+  int woken;                   // made RUNNABLE by wakeup, for the auto-tuner
 #ifdef F_BENCH
   uint childticks;
   uint children;
+  uint64 childrtime;
+  uint64 childwtime;
+  uint64 childstime;
 #endif
 };
 
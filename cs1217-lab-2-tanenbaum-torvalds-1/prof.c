@@ -0,0 +1,178 @@
+// Sampling kernel profiler.
+//
+// While profiling is on, each CPU's timer interrupt also fires
+// every PROF_US (see timerarm()) and records the interrupted pc,
+// plus a call chain found by following saved frame pointers when
+// the CPU was in the kernel, into the CPU's own ring buffer.  The
+// rings work like those of trace.c.
+//
+// Code that runs with interrupts off cannot be sampled, so time
+// spent spinning in acquire() is charged to the release() or
+// popcli() that ends it.  The call chain still shows who held the
+// lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "prof.h"
+
+#define NPROF   512    // samples per CPU; must be a power of two
+#define PROF_US 1000   // sampling interval
+#define PROFPG  (PGSIZE / sizeof(struct profsample))  // samples per copy
+
+struct profring {
+  volatile uint head;   // next slot to fill, written by the owning CPU
+  volatile uint tail;   // next slot to read, written by readers
+  uint dropped;
+  struct profsample s[NPROF];
+};
+
+static struct profring rings[NCPU];
+static struct spinlock proflock;
+volatile int profiling;
+
+void
+profinit(void)
+{
+  initlock(&proflock, "prof");
+}
+
+// Called from the timer interrupt: record a sample if one is due.
+void
+profintr(struct trapframe *tf)
+{
+  struct cpu *c;
+  struct proc *p;
+  struct profring *r;
+  struct profsample *s;
+  uint *ebp;
+  uint64 now;
+  int i;
+
+  if(!profiling)
+    return;
+  c = mycpu();
+  now = rdtsc();
+  if(now < c->nextsample)
+    return;
+  c->nextsample = now + (uint64)PROF_US * tscmhz;
+
+  r = &rings[c - cpus];
+  if(r->head - r->tail >= NPROF){
+    r->dropped++;
+    return;
+  }
+  s = &r->s[r->head & (NPROF-1)];
+  p = c->proc;
+  s->pid = p ? p->pid : 0;
+  s->cpu = c - cpus;
+  s->user = (tf->cs & 3) == DPL_USER;
+  s->pc[0] = tf->eip;
+  i = 1;
+  if(!s->user){
+    // Walk saved %ebp chains on the kernel stack, giving up on
+    // anything that does not look like one (e.g. in trapasm.S).
+    ebp = (uint*)tf->ebp;
+    for(; i < PROF_DEPTH; i++){
+      if((uint)ebp < KERNBASE || (uint)ebp >= (uint)P2V(PHYSTOP) - 8 ||
+         (uint)ebp % 4 != 0)
+        break;
+      s->pc[i] = ebp[1];     // saved %eip
+      ebp = (uint*)ebp[0];   // saved %ebp
+    }
+  }
+  for(; i < PROF_DEPTH; i++)
+    s->pc[i] = 0;
+  __sync_synchronize();   // publish the slot before head
+  r->head++;
+}
+
+// Copy up to n samples into buf.  Returns the number copied.
+static int
+profread(struct profsample *buf, int n)
+{
+  struct profring *r;
+  uint head;
+  int i, got;
+
+  got = 0;
+  for(i = 0; i < ncpu && got < n; i++){
+    r = &rings[i];
+    head = r->head;
+    __sync_synchronize();   // read slots only after their head
+    while(r->tail != head && got < n){
+      buf[got++] = r->s[r->tail & (NPROF-1)];
+      __sync_synchronize();   // finish the copy before freeing the slot
+      r->tail++;
+    }
+  }
+  return got;
+}
+
+// Copy up to n samples to user address ubuf, draining them into a
+// kernel page under proflock and copying out after releasing it.
+// Returns the number copied, or -1 if ubuf is bad.
+static int
+profcopy(uint ubuf, int n)
+{
+  struct profsample *kbuf;
+  int got, m;
+
+  if((kbuf = (struct profsample*)kalloc()) == 0)
+    return -1;
+  for(got = 0; got < n; got += m){
+    acquire(&proflock);
+    m = profread(kbuf, n - got < PROFPG ? n - got : PROFPG);
+    release(&proflock);
+    if(m == 0)
+      break;
+    if(copyout(myproc()->pgdir, ubuf + got*sizeof(*kbuf), kbuf, m*sizeof(*kbuf)) < 0){
+      got = -1;
+      break;
+    }
+  }
+  kfree((char*)kbuf);
+  return got;
+}
+
+int
+profctl(int op, uint buf, int n)
+{
+  int i, r;
+
+  if(op == PROF_READ)
+    return profcopy(buf, n);
+
+  acquire(&proflock);
+  r = 0;
+  switch(op){
+  case PROF_OFF:
+    profiling = 0;
+    break;
+  case PROF_ON:
+    profiling = 0;
+    for(i = 0; i < ncpu; i++){
+      rings[i].tail = rings[i].head;
+      rings[i].dropped = 0;
+      cpus[i].nextsample = 0;
+    }
+    profiling = 1;
+    break;
+  case PROF_DROPPED:
+    for(i = 0; i < ncpu; i++)
+      r += rings[i].dropped;
+    break;
+  case PROF_ACTIVE:
+    r = profiling;
+    break;
+  default:
+    r = -1;
+  }
+  release(&proflock);
+  return r;
+}
@@ -0,0 +1,23 @@
+#ifndef _PROF_H_
+#define _PROF_H_
+
+// Kernel profiler samples, as returned by profctl(PROF_READ, ...).
+
+#define PROF_DEPTH 8    // pcs per sample
+
+struct profsample {
+  unsigned int pc[PROF_DEPTH];  // interrupted pc, then return addresses;
+                                // unused entries are 0
+  int pid;                      // process running, or 0
+  unsigned short cpu;
+  unsigned short user;          // 1 if in user space; only pc[0] is set
+};
+
+// profctl() operations
+#define PROF_OFF      0   // stop sampling
+#define PROF_ON       1   // discard old samples and start sampling
+#define PROF_READ     2   // drain up to n samples into buf
+#define PROF_DROPPED  3   // samples lost to full buffers since PROF_ON
+#define PROF_ACTIVE   4   // 1 if sampling, else 0
+
+#endif // _PROF_H_
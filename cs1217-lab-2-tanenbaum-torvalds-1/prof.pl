@@ -0,0 +1,95 @@
+#!/usr/bin/perl
+
+# Symbolize kernel profiler samples from a captured xv6 console log.
+#
+# usage: ./prof.pl [-f] kernel.sym [log...]
+#
+# Reads the "PROF" lines that kprof prints and looks their pcs up
+# in kernel.sym.  By default prints a flat profile: for each
+# function, the samples taken while it was running (self) and
+# while it was anywhere on the call chain (total).  With -f prints
+# folded stacks instead, one "outer;...;inner count" line per call
+# chain, which is the input format of flamegraph.pl.
+
+$folded = 0;
+if(@ARGV && $ARGV[0] eq "-f"){
+	$folded = 1;
+	shift @ARGV;
+}
+die "usage: prof.pl [-f] kernel.sym [log...]\n" unless @ARGV;
+
+$symfile = shift @ARGV;
+open(SYM, $symfile) || die "prof.pl: cannot open $symfile: $!\n";
+while(<SYM>){
+	($addr, $name) = split;
+	next unless defined($name) && $addr =~ /^[0-9a-f]+$/;
+	# Skip section names and source file names.
+	next if $name =~ /^\./ || $name =~ /\.[cS]$/;
+	push(@syms, [hex($addr), $name]);
+}
+close(SYM);
+@syms = sort { $a->[0] <=> $b->[0] } @syms;
+die "prof.pl: no symbols in $symfile\n" unless @syms;
+
+# Name of the symbol containing address $pc.
+sub lookup {
+	local($pc) = @_;
+	local($lo, $hi, $mid);
+
+	return sprintf("0x%x", $pc) if $pc < $syms[0][0];
+	($lo, $hi) = (0, $#syms);
+	while($lo < $hi){
+		$mid = int(($lo + $hi + 1) / 2);
+		if($syms[$mid][0] <= $pc){
+			$lo = $mid;
+		}else{
+			$hi = $mid - 1;
+		}
+	}
+	return $syms[$lo][1];
+}
+
+$total = 0;
+$dropped = 0;
+while(<>){
+	s/\r//g;
+	if(/^PROF dropped (\d+)/){
+		$dropped += $1;
+		next;
+	}
+	next unless /^PROF (\d+) ([ku])((?: [0-9a-f]+)*)\s*$/;
+	($n, $mode, @pcs) = ($1, $2, split(' ', $3));
+	$total += $n;
+	@fn = ();
+	if($mode eq "u"){
+		@fn = ("[user]");
+	}else{
+		# Callers' pcs are return addresses; look up the call.
+		for($i = 0; $i < @pcs; $i++){
+			push(@fn, lookup(hex($pcs[$i]) - ($i ? 1 : 0)));
+		}
+	}
+	next unless @fn;
+	$self{$fn[0]} += $n;
+	%seen = ();
+	foreach $f (@fn){
+		$incl{$f} += $n unless $seen{$f}++;
+	}
+	$fold{join(";", reverse @fn)} += $n;
+}
+die "prof.pl: no PROF samples found\n" unless $total;
+
+if($folded){
+	foreach $s (sort keys %fold){
+		print "$s $fold{$s}\n";
+	}
+	exit 0;
+}
+
+printf("%8s %6s %8s %6s  %s\n", "self", "", "total", "", "function");
+foreach $f (sort { $self{$b} <=> $self{$a} || $incl{$b} <=> $incl{$a} ||
+    $a cmp $b } keys %incl){
+	printf("%8d %5.1f%% %8d %5.1f%%  %s\n", $self{$f},
+		100 * $self{$f} / $total, $incl{$f}, 100 * $incl{$f} / $total, $f);
+}
+printf("%d samples, %d dropped\n", $total, $dropped);
@@ -7,21 +7,25 @@
 int
 main(int argc, char *argv[])
 {
-  struct pstat p;
-  int success = settickets(53);
-  success = getpinfo(&p);
+  static struct pstat p;
+  int n, pid;
+  settickets(53);
 
-  if (success < 0) 
+  printf(1, "ID\tTIX\tTCK\tRUN\tWAIT\tSLEEP\tLOCK (ms)\n");
+  for (pid = 0; ; pid = p.pid[n - 1] + 1)
   {
-    printf(1, "Unable to retrieve process information\n");
-    exit();
-  }
-
-  printf(1, "ID\tTIX\tTCK\n");
-  for (int i = 0; i < NPROC; i++)
-  {
-    if (!p.inuse[i]) continue;
-    printf(1, "%d\t%d\t%d\n", p.pid[i], p.tickets[i], p.ticks[i]);
+    if ((n = getpinfo(&p, pid)) < 0)
+    {
+      printf(1, "Unable to retrieve process information\n");
+      exit();
+    }
+    for (int i = 0; i < n; i++)
+    {
+      printf(1, "%d\t%d\t%d\t%d\t%d\t%d\t%d\n", p.pid[i], p.tickets[i], p.ticks[i],
+             p.rtime[i] / 1000, p.wtime[i] / 1000, p.stime[i] / 1000,
+             p.locktime[i] / 1000);
+    }
+    if (n < NPSTAT) break;
   }
 
   exit();
@@ -1,13 +1,21 @@
 #ifndef _PSTAT_H_
 #define _PSTAT_H_
 
-#include "param.h"
+#define NPSTAT 64     // processes reported per getpinfo() call
 
+// getpinfo(&ps, pid) fills in the processes with the lowest pids
+// from pid up, at most NPSTAT of them, and returns how many.  To
+// see them all, ask again from one past the last pid until it
+// returns fewer than NPSTAT.
 struct pstat {
-  int inuse[NPROC];   // whether this slot of the process table is in use (1 or 0)
-  int tickets[NPROC]; // the number of tickets this process has
-  int pid[NPROC];     // the PID of each process 
-  int ticks[NPROC];   // the number of ticks each process has accumulated 
+  int tickets[NPSTAT]; // the number of tickets this process has
+  int currency[NPSTAT]; // the lottery currency they are in
+  int pid[NPSTAT];     // the PID of each process
+  int ticks[NPSTAT];   // the number of ticks each process has accumulated
+  int rtime[NPSTAT];   // microseconds spent running, measured with the TSC
+  int wtime[NPSTAT];   // microseconds spent runnable but waiting for a CPU
+  int stime[NPSTAT];   // microseconds spent sleeping
+  int locktime[NPSTAT]; // microseconds of that spent waiting for sleeplocks
 };
 
 #endif // _PSTAT_H_
\ No newline at end of file
@@ -0,0 +1,331 @@
+// Scheduler benchmark driver.
+//
+// usage: schedbench [mix [nproc [scale [runs]]]]
+//
+// Forks nproc jobs of the given mix, waits for them all, and
+// reports turnaround and response time per job, plus Jain's
+// fairness index and throughput for the run.  Mixes:
+//
+//   cpu          compute-bound loops
+//   io           file writes and reads
+//   interactive  short bursts separated by 1 ms sleeps
+//   fork         each job forks and reaps scale children
+//   mixed        the above, round-robin
+//   all          every mix in turn
+//
+// scale sets the amount of work per job.  Jobs are identical for a
+// given (mix, nproc, scale), so runs are comparable across
+// schedulers.  All output is on lines of the form
+//
+//   BENCH key=value ...
+//
+// which schedbench.pl collects from a captured console log.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "pstat.h"
+#include "benchinfo.h"
+#include "schedtrace.h"
+
+#define MAXJOBS 32
+
+enum { K_CPU, K_IO, K_INTERACTIVE, K_FORK, NKIND };
+
+static char *kindname[] = { "cpu", "io", "interactive", "fork" };
+static char *schedname[] = { "basic", "mlfq", "lottery" };
+
+// Sent up the pipe by every job when it first runs and just
+// before it exits.
+struct report {
+  int job;
+  int done;
+  unsigned long long tsc;
+  uint cpu;                  // microseconds run, on the done report
+};
+
+struct job {
+  int kind;
+  int pid;
+  unsigned long long forked, started, ended;
+  uint cpu;
+};
+
+static struct job jobs[MAXJOBS];
+static int mhz;
+
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// 64-bit division by shift and subtract; there is no libgcc.
+static unsigned long long
+div64(unsigned long long n, unsigned long long d)
+{
+  unsigned long long q, bit;
+
+  if(d == 0)
+    return 0;
+  q = 0;
+  bit = 1;
+  while(d < n && (d >> 63) == 0){
+    d <<= 1;
+    bit <<= 1;
+  }
+  while(bit){
+    if(n >= d){
+      n -= d;
+      q |= bit;
+    }
+    d >>= 1;
+    bit >>= 1;
+  }
+  return q;
+}
+
+static uint
+us(unsigned long long cycles)
+{
+  return div64(cycles, mhz);
+}
+
+static int
+fib(int n)
+{
+  if(n <= 2)
+    return n > 0;
+  return fib(n - 1) + fib(n - 2);
+}
+
+static void
+cpujob(int scale)
+{
+  fib(16 + scale / 4);
+}
+
+static void
+iojob(int job, int scale)
+{
+  char name[8], buf[512];
+  int i, fd;
+
+  strcpy(name, "sb00");
+  name[2] = '0' + job / 10;
+  name[3] = '0' + job % 10;
+  memset(buf, 'a' + job % 26, sizeof(buf));
+  if((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    return;
+  for(i = 0; i < scale; i++)
+    write(fd, buf, sizeof(buf));
+  close(fd);
+  if((fd = open(name, O_RDONLY)) >= 0){
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+  }
+  unlink(name);
+}
+
+static void
+interactivejob(int scale)
+{
+  int i;
+
+  for(i = 0; i < scale; i++){
+    nanosleep(0, 1000000);
+    fib(12);
+  }
+}
+
+static void
+forkjob(int scale)
+{
+  int i, pid;
+
+  for(i = 0; i < scale; i++){
+    if((pid = fork()) == 0)
+      exit();
+    if(pid > 0)
+      wait();
+  }
+}
+
+// This process's run time so far, in microseconds.
+static uint
+cputime(void)
+{
+  static struct pstat ps;
+  int pid;
+
+  pid = getpid();
+  if(getpinfo(&ps, pid) > 0 && ps.pid[0] == pid)
+    return ps.rtime[0];
+  return 0;
+}
+
+static void
+runjob(int fd, int job, int scale)
+{
+  struct report r;
+
+  r.job = job;
+  r.done = 0;
+  r.tsc = rdtsc();
+  r.cpu = 0;
+  write(fd, &r, sizeof(r));
+
+  switch(jobs[job].kind){
+  case K_CPU:
+    cpujob(scale);
+    break;
+  case K_IO:
+    iojob(job, scale);
+    break;
+  case K_INTERACTIVE:
+    interactivejob(scale);
+    break;
+  case K_FORK:
+    forkjob(scale);
+    break;
+  }
+
+  r.done = 1;
+  r.cpu = cputime();
+  r.tsc = rdtsc();
+  write(fd, &r, sizeof(r));
+  exit();
+}
+
+static void
+run(char *mix, int kind, int nproc, int scale)
+{
+  struct benchinfo before, after;
+  struct report r;
+  struct job *j;
+  int i, p[2], sched;
+  unsigned long long t0, t1, sum, sumsq, x;
+  uint turn, resp, makespan;
+  unsigned long long sumturn, sumresp;
+
+  if(pipe(p) < 0){
+    printf(2, "schedbench: pipe failed\n");
+    exit();
+  }
+  sched = -1;
+  if(benchinfo(&before) == 0)
+    sched = before.scheduler;
+
+  t0 = rdtsc();
+  for(i = 0; i < nproc; i++){
+    j = &jobs[i];
+    j->kind = kind < 0 ? i % NKIND : kind;
+    j->started = j->ended = 0;
+    j->cpu = 0;
+    j->forked = rdtsc();
+    if((j->pid = fork()) == 0){
+      close(p[0]);
+      runjob(p[1], i, scale);
+    }
+    if(j->pid < 0){
+      printf(2, "schedbench: fork failed\n");
+      nproc = i;
+      break;
+    }
+  }
+  close(p[1]);
+
+  // Every job's write end closes when it exits, so this reads
+  // until the last job is gone.
+  while(read(p[0], &r, sizeof(r)) == sizeof(r)){
+    if(r.job < 0 || r.job >= nproc)
+      continue;
+    if(r.done){
+      jobs[r.job].ended = r.tsc;
+      jobs[r.job].cpu = r.cpu;
+    } else
+      jobs[r.job].started = r.tsc;
+  }
+  close(p[0]);
+  for(i = 0; i < nproc; i++)
+    wait();
+  t1 = rdtsc();
+
+  printf(1, "BENCH run sched=%s mix=%s nproc=%d scale=%d\n",
+         sched >= 0 && sched < 3 ? schedname[sched] : "unknown",
+         mix, nproc, scale);
+
+  // Jain's index over each job's share of the CPU while it
+  // existed, in per-mille: (sum x)^2 / (n * sum x^2).
+  sum = sumsq = sumturn = sumresp = 0;
+  for(i = 0; i < nproc; i++){
+    j = &jobs[i];
+    turn = us(j->ended - j->forked);
+    resp = us(j->started - j->forked);
+    sumturn += turn;
+    sumresp += resp;
+    x = turn ? div64((unsigned long long)j->cpu * 1000, turn) : 0;
+    sum += x;
+    sumsq += x * x;
+    printf(1, "BENCH job=%d kind=%s turnaround_us=%d response_us=%d cpu_us=%d\n",
+           i, kindname[j->kind], turn, resp, j->cpu);
+  }
+
+  makespan = us(t1 - t0);
+  printf(1, "BENCH summary sched=%s mix=%s nproc=%d scale=%d makespan_us=%d "
+         "avg_turnaround_us=%d avg_response_us=%d jain_x1000=%d "
+         "jobs_per_ksec=%d",
+         sched >= 0 && sched < 3 ? schedname[sched] : "unknown",
+         mix, nproc, scale, makespan,
+         nproc ? (uint)div64(sumturn, nproc) : 0,
+         nproc ? (uint)div64(sumresp, nproc) : 0,
+         sumsq ? (uint)div64(sum * sum * 1000, sumsq * nproc) : 0,
+         makespan ? (uint)div64((unsigned long long)nproc * 1000000000, makespan) : 0);
+  if(sched >= 0 && benchinfo(&after) == 0)
+    printf(1, " child_run_ms=%d child_wait_ms=%d child_sleep_ms=%d",
+           (after.childrtime - before.childrtime) / 1000,
+           (after.childwtime - before.childwtime) / 1000,
+           (after.childstime - before.childstime) / 1000);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *mix;
+  int i, k, nproc, scale, runs;
+
+  mix = argc > 1 ? argv[1] : "mixed";
+  nproc = argc > 2 ? atoi(argv[2]) : 8;
+  scale = argc > 3 ? atoi(argv[3]) : 20;
+  runs = argc > 4 ? atoi(argv[4]) : 1;
+  for(k = 0; k < NKIND; k++)
+    if(strcmp(mix, kindname[k]) == 0)
+      break;
+  if(k == NKIND && strcmp(mix, "mixed") != 0 && strcmp(mix, "all") != 0)
+    nproc = 0;
+  if(nproc < 1 || nproc > MAXJOBS || scale < 1 || runs < 1){
+    printf(2, "usage: schedbench [mix [nproc [scale [runs]]]]\n");
+    exit();
+  }
+  if((mhz = schedtrace(TRACE_MHZ, 0, 0)) <= 0)
+    mhz = 1;
+
+  for(i = 0; i < runs; i++){
+    if(strcmp(mix, "mixed") == 0){
+      run(mix, -1, nproc, scale);
+      continue;
+    }
+    for(k = 0; k < NKIND; k++)
+      if(strcmp(mix, "all") == 0 || strcmp(mix, kindname[k]) == 0)
+        run(kindname[k], k, nproc, scale);
+    if(strcmp(mix, "all") == 0)
+      run("mixed", -1, nproc, scale);
+  }
+  exit();
+}
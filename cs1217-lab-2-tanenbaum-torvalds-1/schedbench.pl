@@ -0,0 +1,52 @@
+#!/usr/bin/perl
+
+# Summarize schedbench results from a captured xv6 console log.
+#
+# usage: ./schedbench.pl [-c] [log...]
+#
+# Reads the "BENCH summary" lines that schedbench prints, averages
+# runs with the same scheduler, mix, nproc and scale, and prints
+# one row per combination.  With -c the rows are comma-separated.
+
+$csv = 0;
+if(@ARGV && $ARGV[0] eq "-c"){
+	$csv = 1;
+	shift @ARGV;
+}
+
+@cols = ("makespan_us", "avg_turnaround_us", "avg_response_us",
+	"jain_x1000", "jobs_per_ksec");
+
+while(<>){
+	s/\r//g;
+	next unless /^BENCH summary (.*)$/;
+	%f = ();
+	foreach $kv (split(' ', $1)){
+		($k, $v) = split(/=/, $kv, 2);
+		$f{$k} = $v;
+	}
+	$key = "$f{sched} $f{mix} $f{nproc} $f{scale}";
+	push(@order, $key) unless exists $n{$key};
+	$n{$key}++;
+	foreach $c (@cols){
+		$sum{$key}{$c} += $f{$c};
+	}
+}
+
+@head = ("sched", "mix", "nproc", "scale", "runs", @cols);
+if($csv){
+	print join(",", @head), "\n";
+}else{
+	printf("%-8s %-12s %5s %5s %4s %12s %17s %15s %10s %13s\n", @head);
+}
+foreach $key (sort @order){
+	@row = (split(' ', $key), $n{$key});
+	foreach $c (@cols){
+		push(@row, int($sum{$key}{$c} / $n{$key} + 0.5));
+	}
+	if($csv){
+		print join(",", @row), "\n";
+	}else{
+		printf("%-8s %-12s %5d %5d %4d %12d %17d %15d %10d %13d\n", @row);
+	}
+}
@@ -0,0 +1,67 @@
+// Read and set kernel tunables.
+//
+// usage: schedctl [name [value]]
+//
+// With no arguments, prints every tunable.  With a name, prints
+// that one; with a value too, sets it.  Names are those of
+// sysctl.h in lower case without the CTL_ prefix.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "sysctl.h"
+
+static char *names[NCTL] = {
+[CTL_SCHEDULER]  "scheduler",
+[CTL_QUANTUM]    "quantum",
+[CTL_BUDGET]     "budget",
+[CTL_BOOST]      "boost",
+[CTL_MAXPRIO]    "maxprio",
+[CTL_SEED]       "seed",
+[CTL_AUTOTUNE]   "autotune",
+[CTL_RESPTARGET] "resptarget",
+[CTL_ORDERED]    "ordered",
+[CTL_LARGEPAGES] "largepages",
+[CTL_MAXPROC]    "maxproc",
+};
+
+static void
+show(int name)
+{
+  int v;
+
+  if(sysctl(name, &v, 0) < 0)
+    printf(2, "schedctl: cannot read %s\n", names[name]);
+  else
+    printf(1, "%s %d\n", names[name], v);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, old, new;
+
+  if(argc < 2){
+    for(i = 0; i < NCTL; i++)
+      show(i);
+    exit();
+  }
+  for(i = 0; i < NCTL; i++)
+    if(strcmp(argv[1], names[i]) == 0)
+      break;
+  if(i == NCTL || argc > 3){
+    printf(2, "usage: schedctl [name [value]]\n");
+    exit();
+  }
+  if(argc == 2){
+    show(i);
+    exit();
+  }
+  new = atoi(argv[2]);
+  if(sysctl(i, &old, &new) < 0){
+    printf(2, "schedctl: cannot set %s to %d\n", names[i], new);
+    exit();
+  }
+  printf(1, "%s %d -> %d\n", names[i], old, new);
+  exit();
+}
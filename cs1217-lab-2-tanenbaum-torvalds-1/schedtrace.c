@@ -0,0 +1,209 @@
+// Trace the scheduler while a command runs and print, for every
+// process that ran, histograms of its scheduling latency (time from
+// becoming runnable to being switched in) and of its run lengths
+// (time from switch-in to switch-out), both in microseconds.
+//
+// usage: schedtrace command [args...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "schedtrace.h"
+
+#define NBUF     256   // events per TRACE_READ
+#define NSTAT    64    // processes tracked
+#define NBUCKET  24    // log2 buckets: [0,2), [2,4), ... microseconds
+#define BARWIDTH 40
+
+struct stats {
+  int pid;
+  unsigned long long ready;   // tsc at which it became runnable, or 0
+  unsigned long long in;      // tsc at which it was switched in, or 0
+  uint nlat, nrun, nprio;
+  int exited;
+  uint lat[NBUCKET];
+  uint run[NBUCKET];
+};
+
+static struct traceevent buf[NBUF];
+static struct stats stats[NSTAT];
+static int nstats;
+static int mhz;
+static int nboost, lost;
+
+static struct stats*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < nstats; i++)
+    if(stats[i].pid == pid)
+      return &stats[i];
+  if(nstats == NSTAT){
+    lost++;
+    return 0;
+  }
+  memset(&stats[nstats], 0, sizeof(stats[nstats]));
+  stats[nstats].pid = pid;
+  return &stats[nstats++];
+}
+
+// Add the interval from start to end to histogram h.
+static void
+record(uint *h, unsigned long long start, unsigned long long end)
+{
+  unsigned long long d;
+  uint us;
+  int b;
+
+  d = end - start;
+  if(d >> 32)
+    d = 0xffffffff;
+  us = (uint)d / mhz;
+  for(b = 0; b < NBUCKET - 1 && (us >> (b + 1)) != 0; b++)
+    ;
+  h[b]++;
+}
+
+static void
+event(struct traceevent *e)
+{
+  struct stats *s;
+
+  if(e->type == TR_BOOST){
+    nboost++;
+    return;
+  }
+  if(e->type == TR_FORK){
+    if((s = lookup(e->arg)) != 0)
+      s->ready = e->tsc;
+    return;
+  }
+  if((s = lookup(e->pid)) == 0)
+    return;
+
+  switch(e->type){
+  case TR_WAKEUP:
+    s->ready = e->tsc;
+    break;
+  case TR_SWITCHIN:
+    if(s->ready){
+      record(s->lat, s->ready, e->tsc);
+      s->nlat++;
+      s->ready = 0;
+    }
+    s->in = e->tsc;
+    break;
+  case TR_SWITCHOUT:
+    if(s->in){
+      record(s->run, s->in, e->tsc);
+      s->nrun++;
+      s->in = 0;
+    }
+    if(e->arg == TRS_RUNNABLE)
+      s->ready = e->tsc;
+    break;
+  case TR_PRIO:
+    s->nprio++;
+    break;
+  case TR_EXIT:
+    s->exited = 1;
+    break;
+  }
+}
+
+static void
+histogram(char *name, uint *h, uint n)
+{
+  uint max;
+  int b, i, lo, hi, w;
+
+  if(n == 0)
+    return;
+  max = 0;
+  for(b = 0; b < NBUCKET; b++)
+    if(h[b] > max)
+      max = h[b];
+  printf(1, "  %s (us)\n", name);
+  for(lo = 0; lo < NBUCKET && h[lo] == 0; lo++)
+    ;
+  for(hi = NBUCKET - 1; hi > lo && h[hi] == 0; hi--)
+    ;
+  for(b = lo; b <= hi; b++){
+    printf(1, "    [%d, %d)\t%d\t", b == 0 ? 0 : 1 << b, 1 << (b + 1), h[b]);
+    w = (h[b] * BARWIDTH + max - 1) / max;
+    for(i = 0; i < w; i++)
+      printf(1, "*");
+    printf(1, "\n");
+  }
+}
+
+// Drain the trace buffers.  Returns the number of events read.
+static int
+drain(void)
+{
+  int i, n, total;
+
+  total = 0;
+  while((n = schedtrace(TRACE_READ, buf, NBUF)) > 0){
+    for(i = 0; i < n; i++)
+      event(&buf[i]);
+    total += n;
+  }
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, self;
+  struct stats *child;
+
+  if(argc < 2){
+    printf(2, "usage: schedtrace command [args...]\n");
+    exit();
+  }
+  if((mhz = schedtrace(TRACE_MHZ, 0, 0)) <= 0){
+    printf(2, "schedtrace: tracing not supported\n");
+    exit();
+  }
+
+  self = getpid();
+  schedtrace(TRACE_ON, 0, 0);
+  pid = fork();
+  if(pid < 0){
+    printf(2, "schedtrace: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    printf(2, "schedtrace: exec %s failed\n", argv[1]);
+    exit();
+  }
+
+  // Keep the rings from filling while the command runs, and
+  // watch the trace itself for the command's exit.
+  child = lookup(pid);
+  while(!child->exited){
+    if(drain() == 0)
+      sleep(1);
+  }
+  wait();
+  schedtrace(TRACE_OFF, 0, 0);
+  drain();
+
+  for(i = 0; i < nstats; i++){
+    if(stats[i].pid == self || stats[i].nrun == 0)
+      continue;
+    printf(1, "pid %d: %d runs, %d waits, %d priority changes\n",
+           stats[i].pid, stats[i].nrun, stats[i].nlat, stats[i].nprio);
+    histogram("latency", stats[i].lat, stats[i].nlat);
+    histogram("run length", stats[i].run, stats[i].nrun);
+  }
+  printf(1, "%d boosts, %d events dropped", nboost,
+         schedtrace(TRACE_DROPPED, 0, 0));
+  if(lost)
+    printf(1, ", %d for untracked processes", lost);
+  printf(1, "\n");
+  exit();
+}
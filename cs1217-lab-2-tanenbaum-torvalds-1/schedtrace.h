@@ -0,0 +1,35 @@
+#ifndef _SCHEDTRACE_H_
+#define _SCHEDTRACE_H_
+
+// Scheduler trace events, as returned by schedtrace(TRACE_READ, ...).
+
+#define TR_SWITCHIN   1   // arg: priority
+#define TR_SWITCHOUT  2   // arg: new state (enum procstate)
+#define TR_WAKEUP     3   // arg: priority
+#define TR_PRIO       4   // arg: new priority
+#define TR_BOOST      5   // pid 0, arg: processes promoted
+#define TR_FORK       6   // pid is the parent, arg: child pid
+#define TR_EXIT       7   // arg: 0
+
+// States reported by TR_SWITCHOUT; these mirror enum procstate.
+#define TRS_SLEEPING  2
+#define TRS_RUNNABLE  3
+#define TRS_ZOMBIE    5
+
+// schedtrace() operations
+#define TRACE_OFF     0   // stop recording
+#define TRACE_ON      1   // discard old events and start recording
+#define TRACE_READ    2   // drain up to n events into buf
+#define TRACE_DROPPED 3   // events lost to full buffers since TRACE_ON
+#define TRACE_MHZ     4   // TSC cycles per microsecond
+
+struct traceevent {
+  unsigned long long tsc;   // rdtsc() on the recording CPU
+  unsigned short type;      // TR_*
+  unsigned short cpu;
+  int pid;
+  int arg;
+  int pad;
+};
+
+#endif // _SCHEDTRACE_H_
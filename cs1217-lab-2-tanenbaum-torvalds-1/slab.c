@@ -0,0 +1,249 @@
+// Slab allocator for small kernel objects.
+//
+// kalloc() only hands out whole 4096-byte pages, which wastes most
+// of a page on objects like pipes, open files and in-memory inodes.
+// kmalloc() carves pages ("slabs") into equal-sized objects, one
+// size class per slab, and kmfree() gives them back.
+//
+// Every slab is exactly one page and begins with a struct slab
+// header, so kmfree() finds an object's slab (and hence its size
+// class) by rounding the address down to a page boundary; callers
+// do not pass the size back.
+//
+// Each CPU keeps a small magazine of free objects per size class,
+// so the common kmalloc()/kmfree() pair touches no shared lock.
+// When a magazine runs empty or fills up, half a magazine is moved
+// between it and the class's slabs under the class's spinlock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define SLAB_MAGIC 0x51ab51ab
+#define SLAB_HDR   32      // bytes reserved at the start of each slab
+#define MAGSIZE    16      // objects held per CPU per size class
+
+// Object sizes.  The odd classes keep common objects from
+// wasting a power of two: a pipe (~580 bytes) fits five to a
+// page in the 768 class instead of one to a page.
+static uint classsize[] = {
+  16, 32, 64, 128, 192, 256, 384, 512, 768, 1024, PGSIZE - SLAB_HDR,
+};
+
+#define NSLABCLASS NELEM(classsize)
+
+struct object {
+  struct object *next;
+};
+
+struct kmclass;
+
+struct slab {
+  uint magic;
+  struct kmclass *cls;      // size class of every object in this slab
+  struct slab *next;        // partial list links
+  struct slab *prev;
+  uint nfree;               // number of objects on freelist
+  struct object *freelist;
+};
+
+struct kmclass {
+  struct spinlock lock;
+  uint size;                // object size in bytes
+  uint perslab;             // objects per slab
+  struct slab partial;      // slabs with at least one free object
+  uint nslab;               // slabs currently allocated
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+static struct kmclass kmclass[NSLABCLASS];
+static struct magazine magazine[NCPU][NSLABCLASS];
+
+void
+slabinit(void)
+{
+  struct kmclass *c;
+  int i;
+
+  if(sizeof(struct slab) > SLAB_HDR)
+    panic("slabinit: header");
+
+  for(i = 0; i < NSLABCLASS; i++){
+    c = &kmclass[i];
+    initlock(&c->lock, "kmclass");
+    c->size = classsize[i];
+    c->perslab = (PGSIZE - SLAB_HDR) / c->size;
+    c->partial.next = &c->partial;
+    c->partial.prev = &c->partial;
+    c->nslab = 0;
+  }
+}
+
+static struct kmclass*
+sizeclass(uint size)
+{
+  int i;
+
+  for(i = 0; i < NSLABCLASS; i++)
+    if(size <= classsize[i])
+      return &kmclass[i];
+  return 0;
+}
+
+// Unlink slab s from its class's partial list.
+static void
+unlinkslab(struct slab *s)
+{
+  s->prev->next = s->next;
+  s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// Put slab s at the front of its class's partial list.
+static void
+linkslab(struct kmclass *c, struct slab *s)
+{
+  s->next = c->partial.next;
+  s->prev = &c->partial;
+  c->partial.next->prev = s;
+  c->partial.next = s;
+}
+
+// Carve a fresh page into objects of class c.
+// Caller must hold c->lock.
+static struct slab*
+newslab(struct kmclass *c)
+{
+  struct slab *s;
+  struct object *o;
+  char *p;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->magic = SLAB_MAGIC;
+  s->cls = c;
+  s->nfree = 0;
+  s->freelist = 0;
+  p = (char*)s + SLAB_HDR;
+  for(i = c->perslab - 1; i >= 0; i--){
+    o = (struct object*)(p + i*c->size);
+    o->next = s->freelist;
+    s->freelist = o;
+    s->nfree++;
+  }
+  linkslab(c, s);
+  c->nslab++;
+  return s;
+}
+
+// Move up to n objects of class c into magazine m.
+// Caller must hold c->lock.
+static void
+refill(struct kmclass *c, struct magazine *m, int n)
+{
+  struct slab *s;
+  struct object *o;
+
+  while(n > 0 && m->n < MAGSIZE){
+    s = c->partial.next;
+    if(s == &c->partial && (s = newslab(c)) == 0)
+      break;
+    while(n > 0 && m->n < MAGSIZE && s->freelist){
+      o = s->freelist;
+      s->freelist = o->next;
+      s->nfree--;
+      m->obj[m->n++] = o;
+      n--;
+    }
+    if(s->nfree == 0)
+      unlinkslab(s);   // full slabs are on no list
+  }
+}
+
+// Return object v to its slab.  A slab that becomes entirely
+// free goes back to kalloc() unless it is the last partial slab
+// of its class, which is kept to absorb alloc/free ping-pong.
+// Caller must hold c->lock.
+static void
+putobject(struct kmclass *c, void *v)
+{
+  struct slab *s;
+  struct object *o;
+
+  s = (struct slab*)PGROUNDDOWN((uint)v);
+  o = (struct object*)v;
+  o->next = s->freelist;
+  s->freelist = o;
+  if(s->nfree++ == 0)
+    linkslab(c, s);
+  if(s->nfree == c->perslab &&
+     (c->partial.next != s || s->next != &c->partial)){
+    unlinkslab(s);
+    s->magic = 0;
+    c->nslab--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate size bytes of kernel memory.
+// Returns 0 if size is too large or memory is exhausted.
+void*
+kmalloc(uint size)
+{
+  struct kmclass *c;
+  struct magazine *m;
+  void *v;
+
+  if((c = sizeclass(size)) == 0)
+    return 0;
+
+  pushcli();
+  m = &magazine[cpuid()][c - kmclass];
+  if(m->n == 0){
+    acquire(&c->lock);
+    refill(c, m, MAGSIZE/2);
+    release(&c->lock);
+  }
+  v = 0;
+  if(m->n > 0)
+    v = m->obj[--m->n];
+  popcli();
+  return v;
+}
+
+// Free memory returned by kmalloc().
+void
+kmfree(void *v)
+{
+  struct slab *s;
+  struct kmclass *c;
+  struct magazine *m;
+  int i;
+
+  s = (struct slab*)PGROUNDDOWN((uint)v);
+  if(v == 0 || (uint)v % sizeof(struct object*) != 0 ||
+     (char*)v < (char*)s + SLAB_HDR || s->magic != SLAB_MAGIC)
+    panic("kmfree");
+  c = s->cls;
+
+  pushcli();
+  m = &magazine[cpuid()][c - kmclass];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    for(i = 0; i < MAGSIZE/2; i++)
+      putobject(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = v;
+  popcli();
+}
@@ -17,17 +17,39 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->owner = 0;
+  lk->waiters = 0;
+  lk->nextheld = 0;
+  lk->nwait = 0;
+  lk->waittime = 0;
+  lk->maxwait = 0;
 }
 
+// While a process waits, the holder inherits its priority
+// (see inheritblock() in proc.c), so a low-priority holder
+// cannot be starved by processes in between.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  uint64 start, waited;
+
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  if(lk->locked){
+    start = rdtsc();
+    while (lk->locked) {
+      inheritblock(lk);
+      sleep(lk, &lk->lk);
+    }
+    waited = rdtsc() - start;
+    lk->nwait++;
+    lk->waittime += waited;
+    if(waited > lk->maxwait)
+      lk->maxwait = waited;
+    myproc()->locktime += waited;
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  inherithold(lk);
   release(&lk->lk);
 }
 
@@ -35,6 +57,7 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  inheritdrop(lk);
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);
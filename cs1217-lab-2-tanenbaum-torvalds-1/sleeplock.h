@@ -2,6 +2,17 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+
+  // Priority inheritance; see proc.c:
+  struct proc *owner;          // Process holding lock, protected by lk
+  struct proc *waiters;        // Processes blocked on it, and
+  struct sleeplock *nextheld;  // owner's other locks with waiters,
+                               // protected by lk and ptable.lock
+
+  // Contention statistics, protected by lk:
+  uint nwait;        // Acquisitions that had to wait
+  uint64 waittime;   // Total TSC cycles spent waiting
+  uint64 maxwait;    // Longest single wait
   
   // For debugging:
   char *name;        // Name of lock.
@@ -21,6 +21,8 @@ fetchint(uint addr, int *ip)
 
   if(addr >= curproc->sz || addr+4 > curproc->sz)
     return -1;
+  if(prefault(addr, 4) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -39,12 +41,33 @@ fetchstr(uint addr, char **pp)
   *pp = (char*)addr;
   ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && prefault((uint)s, 1) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
   }
   return -1;
 }
 
+// Check that the size bytes at addr lie within the current
+// process and are loaded, and set *pp to point at them.  If the
+// kernel is to write them, they must be writable, and any
+// copy-on-write sharing is broken now rather than by a fault.
+int
+fetchbuf(uint addr, char **pp, int size, int write)
+{
+  struct proc *curproc = myproc();
+
+  if(size < 0 || addr >= curproc->sz || addr+size > curproc->sz)
+    return -1;
+  if(prefault(addr, size) < 0)
+    return -1;
+  if(write && uvmwritable(curproc->pgdir, addr, size) < 0)
+    return -1;
+  *pp = (char*)addr;
+  return 0;
+}
+
 // Fetch the nth 32-bit system call argument.
 int
 argint(int n, int *ip)
@@ -54,19 +77,16 @@ argint(int n, int *ip)
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space, and that the block is
+// writable if write is set.
 int
-argptr(int n, char **pp, int size)
+argptr(int n, char **pp, int size, int write)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
-    return -1;
-  *pp = (char*)i;
-  return 0;
+  return fetchbuf(i, pp, size, write);
 }
 
 // Fetch the nth word-sized system call argument as a string pointer.
@@ -108,6 +128,20 @@ extern int sys_getpriority(void);
 extern int sys_settickets(void);
 extern int sys_getpinfo(void);
 extern int sys_benchinfo(void);
+extern int sys_schedtrace(void);
+extern int sys_nanosleep(void);
+extern int sys_setdeadline(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_sendfile(void);
+extern int sys_sysctl(void);
+extern int sys_profctl(void);
+extern int sys_aiosetup(void);
+extern int sys_aioenter(void);
+extern int sys_mount(void);
+extern int sys_tickctl(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]          sys_fork,
@@ -136,6 +170,20 @@ static int (*syscalls[])(void) = {
 [SYS_settickets]    sys_settickets,    
 [SYS_getpinfo]      sys_getpinfo,
 [SYS_benchinfo]     sys_benchinfo,
+[SYS_schedtrace]    sys_schedtrace,
+[SYS_nanosleep]     sys_nanosleep,
+[SYS_setdeadline]   sys_setdeadline,
+[SYS_readv]         sys_readv,
+[SYS_writev]        sys_writev,
+[SYS_sendfile]      sys_sendfile,
+[SYS_sysctl]        sys_sysctl,
+[SYS_profctl]       sys_profctl,
+[SYS_aiosetup]      sys_aiosetup,
+[SYS_aioenter]      sys_aioenter,
+[SYS_mount]         sys_mount,
+[SYS_tickctl]       sys_tickctl,
+[SYS_pread]         sys_pread,
+[SYS_pwrite]        sys_pwrite,
 };
 
 void
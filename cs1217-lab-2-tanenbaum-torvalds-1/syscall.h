@@ -24,4 +24,18 @@
 #define SYS_getpriority 23
 #define SYS_settickets	24
 #define SYS_getpinfo	25
-#define SYS_benchinfo	26
\ No newline at end of file
+#define SYS_benchinfo	26
+#define SYS_schedtrace	27
+#define SYS_nanosleep	28
+#define SYS_setdeadline	29
+#define SYS_readv	30
+#define SYS_writev	31
+#define SYS_sendfile	32
+#define SYS_sysctl	33
+#define SYS_profctl	34
+#define SYS_aiosetup	35
+#define SYS_aioenter	36
+#define SYS_mount	37
+#define SYS_tickctl	38
+#define SYS_pread	39
+#define SYS_pwrite	40
\ No newline at end of file
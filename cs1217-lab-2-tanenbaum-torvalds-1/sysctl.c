@@ -0,0 +1,57 @@
+// Kernel tunables, read and set at run time with sysctl().
+//
+// Each name in sysctl.h maps to a kernel variable and the range
+// of values it accepts.  Values that need more than a store to
+// take effect, such as switching the scheduling policy, have a
+// function to set them.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "sysctl.h"
+
+static struct {
+  int *val;
+  int min, max;
+  void (*set)(int);
+} ctls[NCTL] = {
+[CTL_SCHEDULER]  { (int*)&SCHEDULER, S_BASIC, S_LOTTERY, setscheduler },
+[CTL_QUANTUM]    { (int*)&quantumus, 100, 1000000, 0 },
+[CTL_BUDGET]     { &mlfqbudget, 1, 1000, 0 },
+[CTL_BOOST]      { &boostticks, 1, 100000, 0 },
+[CTL_MAXPRIO]    { &maxprio, 0, NPRIO-1, setmaxprio },
+[CTL_SEED]       { &randseed, 0, 0x7fffffff, setseed },
+[CTL_AUTOTUNE]   { &autotune, 0, 1, 0 },
+[CTL_RESPTARGET] { &resptarget, 1, 10000000, 0 },
+[CTL_ORDERED]    { &logordered, 0, 1, 0 },
+[CTL_LARGEPAGES] { &largepages, 0, 1, 0 },
+[CTL_MAXPROC]    { &maxproc, 1, MAXPROC, 0 },
+};
+
+// Store the value of tunable name in *old, if old is not 0,
+// then set it to *new, if new is not 0.
+int
+sysctl(int name, int *old, int *new)
+{
+  int v;
+
+  if(name < 0 || name >= NCTL || ctls[name].val == 0)
+    return -1;
+  v = 0;
+  if(new){
+    v = *new;
+    if(v < ctls[name].min || v > ctls[name].max)
+      return -1;
+  }
+  if(old)
+    *old = *ctls[name].val;
+  if(new){
+    if(ctls[name].set)
+      ctls[name].set(v);
+    else
+      *ctls[name].val = v;
+  }
+  return 0;
+}
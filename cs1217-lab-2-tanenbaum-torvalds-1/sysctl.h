@@ -0,0 +1,19 @@
+#ifndef _SYSCTL_H_
+#define _SYSCTL_H_
+
+// Kernel tunables for sysctl(name, &old, &new).
+
+#define CTL_SCHEDULER   0   // enum SCHEDULER_TYPE in proc.h
+#define CTL_QUANTUM     1   // time slice, in microseconds
+#define CTL_BUDGET      2   // MLFQ budget, in time slices
+#define CTL_BOOST       3   // ticks between MLFQ priority boosts
+#define CTL_MAXPRIO     4   // highest MLFQ priority
+#define CTL_SEED        5   // lottery random seed; setting it reseeds
+#define CTL_AUTOTUNE    6   // 1 to let the kernel tune CTL_QUANTUM and CTL_BOOST
+#define CTL_RESPTARGET  7   // auto-tuner's target wakeup-to-run time, in us
+#define CTL_ORDERED     8   // 1 to keep file data out of the log
+#define CTL_LARGEPAGES  9   // 1 to map whole 4 MB of user memory with large pages
+#define CTL_MAXPROC     10  // most processes that may exist at once
+#define NCTL            11
+
+#endif // _SYSCTL_H_
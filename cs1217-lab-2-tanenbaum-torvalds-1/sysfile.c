@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -73,7 +74,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 1) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -85,11 +86,97 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 0) < 0)
     return -1;
   return filewrite(f, p, n);
 }
 
+// Read or write at an explicit offset, leaving the file's own
+// offset alone.  Only inodes have offsets.
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 1) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  if(off < 0 || f->type != FD_INODE)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 0) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  if(off < 0 || f->type != FD_INODE)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Fetch the nth system call argument as an array of cnt iovecs
+// into iov, checking each buffer, for writing if write is set.
+static int
+argiov(int n, struct iovec *iov, int cnt, int write)
+{
+  char *p;
+  int i;
+
+  if(cnt < 1 || cnt > IOV_MAX || argptr(n, &p, cnt*sizeof(*iov), 0) < 0)
+    return -1;
+  memmove(iov, p, cnt*sizeof(*iov));
+  for(i = 0; i < cnt; i++)
+    if(fetchbuf((uint)iov[i].iov_base, &p, iov[i].iov_len, write) < 0)
+      return -1;
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, iov, n, 1) < 0)
+    return -1;
+  return filereadv(f, iov, n);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argiov(1, iov, n, 0) < 0)
+    return -1;
+  return filewritev(f, iov, n);
+}
+
+// Copy up to n bytes from file descriptor in to out in the kernel.
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0 ||
+     n < 0)
+    return -1;
+  return filesend(out, in, n);
+}
+
 int
 sys_close(void)
 {
@@ -109,7 +196,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st), 1) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -204,8 +291,12 @@ sys_unlink(void)
   if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
     goto bad;
 
-  if((ip = dirlookup(dp, name, &off)) == 0)
+  if((ip = dirlookup(dp, name, &off, 0)) == 0)
     goto bad;
+  if(ismount(ip)){
+    iput(ip);
+    goto bad;
+  }
   ilock(ip);
 
   if(ip->nlink < 1)
@@ -243,12 +334,13 @@ create(char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
+  int nomem;
 
   if((dp = nameiparent(path, name)) == 0)
     return 0;
   ilock(dp);
 
-  if((ip = dirlookup(dp, name, 0)) != 0){
+  if((ip = dirlookup(dp, name, 0, &nomem)) != 0){
     iunlockput(dp);
     ilock(ip);
     if(type == T_FILE && ip->type == T_FILE)
@@ -256,9 +348,15 @@ create(char *path, short type, short major, short minor)
     iunlockput(ip);
     return 0;
   }
+  if(nomem){
+    iunlockput(dp);   // the name is there, but its inode is not
+    return 0;
+  }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
-    panic("create: ialloc");
+  if((ip = ialloc(dp->dev, type)) == 0){
+    iunlockput(dp);   // tmpfs is full
+    return 0;
+  }
 
   ilock(ip);
   ip->major = major;
@@ -313,6 +411,12 @@ sys_open(void)
       return -1;
     }
   }
+  // A running program may not be opened for writing; see itext().
+  if((omode & (O_WRONLY|O_RDWR)) && ip->ntext > 0){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
 
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
@@ -426,7 +530,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argptr(0, (void*)&fd, 2*sizeof(fd[0]), 1) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -442,3 +546,53 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_aiosetup(void)
+{
+  int va;
+
+  if(argint(0, &va) < 0)
+    return -1;
+  return aiosetup(va);
+}
+
+int
+sys_aioenter(void)
+{
+  int minwait;
+
+  if(argint(0, &minwait) < 0)
+    return -1;
+  return aioenter(minwait);
+}
+
+// Mount a tmpfs on the directory path.
+int
+sys_mount(void)
+{
+  char *path;
+  struct inode *ip;
+
+  if(argstr(0, &path) < 0)
+    return -1;
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  ilock(ip);
+  if(ip->type != T_DIR){
+    iunlockput(ip);
+    end_op();
+    return -1;
+  }
+  iunlock(ip);
+  if(mount(ip) < 0){
+    iput(ip);
+    end_op();
+    return -1;
+  }
+  end_op();
+  return 0;
+}
@@ -8,6 +8,8 @@
 #include "proc.h"
 #include "pstat.h"
 #include "benchinfo.h"
+#include "schedtrace.h"
+#include "prof.h"
 
 int
 sys_fork(void)
@@ -79,6 +81,18 @@ sys_sleep(void)
   return 0;
 }
 
+int
+sys_nanosleep(void)
+{
+  int sec, nsec;
+
+  if(argint(0, &sec) < 0 || argint(1, &nsec) < 0)
+    return -1;
+  if(sec < 0 || nsec < 0)
+    return -1;
+  return nanosleep(sec, nsec);
+}
+
 // return how many clock tick interrupts have occurred
 // since start.
 int
@@ -99,7 +113,7 @@ sys_setpriority(void)
     if(argint(0, &pid) < 0){
         return -1;
     }
-    if(argint(1, &priority) < 0 || argint(1, &priority) > MAXPRIORITY){
+    if(argint(1, &priority) < 0 || priority < 0 || priority > maxprio){
         return -1;
     }
 
@@ -130,17 +144,28 @@ sys_settickets(void)
   return settickets(numtickets);
 }
 
+int
+sys_tickctl(void)
+{
+  int op, a, b;
+
+  if (argint(0, &op) < 0 || argint(1, &a) < 0 || argint(2, &b) < 0)
+    return -1;
+  return tickctl(op, a, b);
+}
+
 int
 sys_getpinfo(void)
 {
   struct pstat *stataddr;
+  int pid;
 
-  if (argptr(0, (char **)&stataddr, sizeof(*stataddr)) < 0)
+  if (argptr(0, (char **)&stataddr, sizeof(*stataddr), 1) < 0 || argint(1, &pid) < 0)
   {
     return -1;
   }
 
-  return getpinfo(stataddr);
+  return getpinfo(stataddr, pid);
 }
 
 int
@@ -152,10 +177,86 @@ sys_benchinfo(void)
   return -1;
 #endif
 
-  if (argptr(0, (char **)&bench, sizeof(*bench)) < 0)
+  if (argptr(0, (char **)&bench, sizeof(*bench), 1) < 0)
   {
     return -1;
   }
 
   return benchinfo(bench);
-}
\ No newline at end of file
+}
+
+int
+sys_schedtrace(void)
+{
+  int op, n;
+  struct traceevent *buf;
+
+  if (argint(0, &op) < 0 || argint(2, &n) < 0 || n < 0)
+  {
+    return -1;
+  }
+  if (argptr(1, (char **)&buf, n * sizeof(*buf), 1) < 0)
+  {
+    return -1;
+  }
+
+  return schedtrace(op, (uint)buf, n);
+}
+
+int
+sys_profctl(void)
+{
+  int op, n;
+  struct profsample *buf;
+
+  if (argint(0, &op) < 0 || argint(2, &n) < 0 || n < 0)
+  {
+    return -1;
+  }
+  if (argptr(1, (char **)&buf, n * sizeof(*buf), 1) < 0)
+  {
+    return -1;
+  }
+
+  return profctl(op, (uint)buf, n);
+}
+
+int
+sys_setdeadline(void)
+{
+  int period, runtime;
+
+  if (argint(0, &period) < 0 || argint(1, &runtime) < 0)
+  {
+    return -1;
+  }
+  if (period < 0 || runtime < 0)
+  {
+    return -1;
+  }
+
+  return setdeadline(period, runtime);
+}
+
+int
+sys_sysctl(void)
+{
+  int name, oldaddr, newaddr;
+  char *old, *new;
+
+  if (argint(0, &name) < 0 || argint(1, &oldaddr) < 0 || argint(2, &newaddr) < 0)
+  {
+    return -1;
+  }
+  old = new = 0;
+  if (oldaddr && fetchbuf(oldaddr, &old, sizeof(int), 1) < 0)
+  {
+    return -1;
+  }
+  if (newaddr && fetchbuf(newaddr, &new, sizeof(int), 0) < 0)
+  {
+    return -1;
+  }
+
+  return sysctl(name, (int*)old, (int*)new);
+}
@@ -0,0 +1,104 @@
+// Check that lottery currencies split the CPU between tenants.
+//
+// usage: tenants [nb [seconds [compensate]]]
+//
+// Runs two tenants under the lottery scheduler, each a currency
+// funded with 100 base tickets: A with one compute-bound worker,
+// B with nb of them.  With compensate set, A's worker instead
+// sleeps for 1 ms after every short burst, and compensation
+// tickets should still win it about its share.  Prints the CPU
+// time each tenant got; with the currencies working, each gets
+// about half however large nb is.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "pstat.h"
+#include "sysctl.h"
+#include "currency.h"
+
+#define MAXB 32
+#define LOTTERY 2     // S_LOTTERY in proc.h
+
+static volatile int sink;
+static struct pstat ps;
+
+static void
+worker(int cur, int bursty)
+{
+  int i;
+
+  if(tickctl(TC_JOIN, cur, 10) < 0)
+    exit();
+  for(;;){
+    for(i = 0; i < (bursty ? 20000 : 1000000); i++)
+      sink += i;
+    if(bursty)
+      nanosleep(0, 1000000);
+  }
+}
+
+// CPU time so far of the n processes in pids, in milliseconds.
+static int
+cputime(int *pids, int n)
+{
+  int j, t;
+
+  t = 0;
+  for(j = 0; j < n; j++)
+    if(getpinfo(&ps, pids[j]) > 0 && ps.pid[0] == pids[j])
+      t += ps.rtime[0] / 1000;
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nb, secs, comp, a, b, i, old, lottery;
+  int pa[1], pb[MAXB], ta, tb;
+
+  nb = argc > 1 ? atoi(argv[1]) : 8;
+  secs = argc > 2 ? atoi(argv[2]) : 5;
+  comp = argc > 3 ? atoi(argv[3]) : 0;
+  if(nb < 1 || nb > MAXB || secs < 1){
+    printf(2, "usage: tenants [nb [seconds [compensate]]]\n");
+    exit();
+  }
+
+  lottery = LOTTERY;
+  if(sysctl(CTL_SCHEDULER, &old, &lottery) < 0){
+    printf(2, "tenants: cannot select the lottery scheduler\n");
+    exit();
+  }
+  if((a = tickctl(TC_CREATE, 0, 100)) < 0 || (b = tickctl(TC_CREATE, 0, 100)) < 0){
+    printf(2, "tenants: cannot create currencies\n");
+    sysctl(CTL_SCHEDULER, 0, &old);
+    exit();
+  }
+  // Outbid both tenants while setting them up.
+  tickctl(TC_JOIN, 0, 100000);
+
+  if((pa[0] = fork()) == 0)
+    worker(a, comp);
+  for(i = 0; i < nb; i++)
+    if((pb[i] = fork()) == 0)
+      worker(b, 0);
+
+  nanosleep(secs, 0);
+  ta = cputime(pa, 1);
+  tb = cputime(pb, nb);
+
+  kill(pa[0]);
+  for(i = 0; i < nb; i++)
+    kill(pb[i]);
+  for(i = 0; i <= nb; i++)
+    wait();
+  tickctl(TC_DESTROY, a, 0);
+  tickctl(TC_DESTROY, b, 0);
+  sysctl(CTL_SCHEDULER, 0, &old);
+
+  printf(1, "tenants: A (1 %s worker) %d ms, B (%d workers) %d ms: "
+         "A got %d%%\n", comp ? "bursty" : "busy", ta, nb, tb,
+         ta + tb ? ta * 100 / (ta + tb) : 0);
+  exit();
+}
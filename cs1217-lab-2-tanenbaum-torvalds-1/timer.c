@@ -0,0 +1,273 @@
+// Timekeeping.
+//
+// Fine-grained time comes from the CPU's time-stamp counter, whose
+// rate timerinit() calibrates once at boot against channel 2 of the
+// 8254 programmable interval timer, calibrating the lapic timer
+// against it at the same time.
+//
+// Each CPU runs its lapic timer in one-shot mode and, after every
+// interrupt, arms it for the earliest of three deadlines: its next
+// clock tick, the end of the current process's time slice, and the
+// earliest pending sleep timer.  The clock tick still advances
+// ticks every TICK_US, but time slices (quantumus) and sleeps are
+// no longer rounded to it.
+//
+// Pending sleeps are kept in a binary min-heap ordered by
+// deadline, protected by timerlock.  Lock order: timerlock, then
+// ptable.lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+#define PIT_HZ     1193182  // 8254 input clock
+#define PIT_CH2    0x42     // channel 2 data port
+#define PIT_MODE   0x43     // mode/command register
+#define PIT_GATE   0x61     // bit 0 gates channel 2, bit 5 is its output
+
+#define CALMS      10       // calibration interval in ms
+#define NTIMER     MAXPROC  // pending timers; one sleep per process
+
+uint tscmhz;                // TSC cycles per microsecond
+uint quantumus = QUANTUM_US;  // time slice length
+
+static uint lapicmhz;       // lapic timer counts per microsecond
+
+struct timer {
+  uint64 when;              // rdtsc() deadline
+  int fired;
+};
+
+static struct spinlock timerlock;
+static struct timer *heap[NTIMER];
+static int nheap;
+
+// Deadline of heap[0], or 0 if there are no timers.  Read without
+// timerlock by timerarm(); a stale value only costs an early
+// interrupt or a late one bounded by the clock tick.
+static volatile uint64 timernext;
+
+void
+timerinit(void)
+{
+  uint latch, l0, l1;
+  uint64 t0, t1;
+
+  initlock(&timerlock, "timer");
+
+  // Count down CALMS ms on channel 2 in mode 0 (interrupt on
+  // terminal count) with the speaker disconnected, and see how
+  // far the TSC and the lapic timer move meanwhile.
+  latch = PIT_HZ / (1000 / CALMS);
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+  outb(PIT_MODE, 0xB0);  // channel 2, lobyte/hibyte, mode 0
+  outb(PIT_CH2, latch & 0xff);
+  outb(PIT_CH2, latch >> 8);
+  lapiconeshot(0xffffffff);
+  l0 = lapiccount();
+  t0 = rdtsc();
+  do {
+    t1 = rdtsc();
+  } while((inb(PIT_GATE) & 0x20) == 0 && t1 - t0 < (1ULL << 34));
+  l1 = lapiccount();
+
+  tscmhz = (uint)(t1 - t0) / (CALMS * 1000);
+  if(tscmhz == 0)
+    tscmhz = 1;
+  lapicmhz = (l0 - l1) / (CALMS * 1000);
+  if(lapicmhz == 0)
+    lapicmhz = 1;
+  cprintf("tsc: %d MHz, lapic timer: %d MHz\n", tscmhz, lapicmhz);
+  lapiconeshot(TICK_US * lapicmhz);
+}
+
+// Convert a TSC cycle count to microseconds.
+uint64
+tsc2us(uint64 cycles)
+{
+  return udiv64(cycles, tscmhz);
+}
+
+// Arm this CPU's lapic timer for its earliest deadline.
+// Caller must have interrupts off.
+static void
+timerarm(uint64 now)
+{
+  struct cpu *c = mycpu();
+  uint64 next, t;
+
+  next = c->nexttick;
+  if(c->sliceend > now && c->sliceend < next)
+    next = c->sliceend;
+  t = timernext;
+  if(t && t < next)
+    next = t;
+  if(profiling && c->nextsample < next)
+    next = c->nextsample;
+  if(next <= now){
+    lapiconeshot(1);
+    return;
+  }
+  // next is at most a tick away, so this cannot overflow.
+  t = udiv64((next - now) * lapicmhz, tscmhz);
+  lapiconeshot(t ? (uint)t : 1);
+}
+
+// Start a time slice of len cycles for the process this CPU is
+// about to run.  Called by the scheduler with interrupts off.
+void
+timerslice(uint64 len)
+{
+  struct cpu *c = mycpu();
+  uint64 now = rdtsc();
+
+  c->sliceend = now + len;
+  timerarm(now);
+}
+
+// Has the current time slice run out?
+int
+timerexpired(void)
+{
+  return rdtsc() >= mycpu()->sliceend;
+}
+
+static void
+heapswap(int i, int j)
+{
+  struct timer *t;
+
+  t = heap[i];
+  heap[i] = heap[j];
+  heap[j] = t;
+}
+
+// Caller must hold timerlock.
+static int
+timeradd(struct timer *t)
+{
+  int i;
+
+  if(nheap == NTIMER)
+    return -1;
+  i = nheap++;
+  heap[i] = t;
+  while(i > 0 && heap[(i-1)/2]->when > heap[i]->when){
+    heapswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  timernext = heap[0]->when;
+  return 0;
+}
+
+// Remove heap[i].  Caller must hold timerlock.
+static void
+timerremove(int i)
+{
+  int c;
+
+  heap[i] = heap[--nheap];
+  while(i > 0 && heap[(i-1)/2]->when > heap[i]->when){
+    heapswap(i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= nheap)
+      break;
+    if(c + 1 < nheap && heap[c+1]->when < heap[c]->when)
+      c++;
+    if(heap[i]->when <= heap[c]->when)
+      break;
+    heapswap(i, c);
+    i = c;
+  }
+  timernext = nheap ? heap[0]->when : 0;
+}
+
+// Remove t if it is still pending.  Caller must hold timerlock.
+static void
+timerdel(struct timer *t)
+{
+  int i;
+
+  for(i = 0; i < nheap; i++){
+    if(heap[i] == t){
+      timerremove(i);
+      return;
+    }
+  }
+}
+
+// Timer interrupt: advance the clock tick, fire expired timers,
+// and rearm for the next deadline.
+void
+timerintr(void)
+{
+  struct cpu *c = mycpu();
+  struct timer *t;
+  uint64 now, tick;
+
+  now = rdtsc();
+  tick = (uint64)TICK_US * tscmhz;
+  if(now >= c->nexttick){
+    c->nexttick += tick;
+    if(c->nexttick <= now)
+      c->nexttick = now + tick;
+    if(cpuid() == 0){
+      acquire(&tickslock);
+      ticks++;
+      wakeup(&ticks);
+      release(&tickslock);
+    }
+  }
+
+  if(timernext && timernext <= now){
+    acquire(&timerlock);
+    while(nheap > 0 && heap[0]->when <= now){
+      t = heap[0];
+      timerremove(0);
+      t->fired = 1;
+      wakeup(t);
+    }
+    release(&timerlock);
+  }
+
+  timerarm(now);
+}
+
+// Sleep for sec seconds plus nsec nanoseconds.
+int
+nanosleep(uint sec, uint nsec)
+{
+  struct timer t;
+
+  if(nsec >= 1000000000)
+    return -1;
+  t.when = rdtsc() + ((uint64)sec * 1000000 + nsec / 1000) * tscmhz;
+  t.fired = 0;
+
+  acquire(&timerlock);
+  if(timeradd(&t) < 0){
+    release(&timerlock);
+    return -1;
+  }
+  // If this is now the earliest deadline, make sure this CPU
+  // wakes up for it; other CPUs pick it up at their next tick.
+  timerarm(rdtsc());
+  while(!t.fired){
+    if(myproc()->killed){
+      timerdel(&t);
+      release(&timerlock);
+      return -1;
+    }
+    sleep(&t, &timerlock);
+  }
+  release(&timerlock);
+  return 0;
+}
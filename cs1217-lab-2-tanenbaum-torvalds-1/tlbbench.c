@@ -0,0 +1,115 @@
+// Measure what large pages save on TLB misses.
+//
+// usage: tlbbench [mb [accesses]]
+//
+// Grows the heap by mb megabytes (default 16), 4 MB aligned, and
+// times accesses to random pages of it, once with the heap mapped
+// in 4 KB pages and once with sysctl largepages set so that
+// allocuvm() maps it 4 MB at a time.  Each access touches a
+// different page, so with 4 KB pages nearly every one misses the
+// TLB once the region is larger than the TLB covers; with large
+// pages a few entries cover it all.  There are no performance
+// counters to count the misses, so the difference in cycles per
+// access stands in for them.  Output lines look like
+//
+//   BENCH tlb largepages=1 mb=16 accesses=1000000 cycles=...
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "sysctl.h"
+
+#define PGSIZE 4096
+#define LPGSIZE (1024*PGSIZE)
+
+static unsigned long randstate = 1;
+
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+static uint
+rand(void)
+{
+  randstate = randstate * 1664525 + 1013904223;
+  return randstate >> 8;
+}
+
+// cycles / n, saturating; there is no libgcc.
+static uint
+perop(unsigned long long cycles, uint n)
+{
+  uint hi, lo, q, r;
+
+  hi = cycles >> 32;
+  lo = cycles;
+  if(hi >= n)
+    return 0xffffffff;
+  asm("divl %4" : "=a"(q), "=d"(r) : "0"(lo), "1"(hi), "rm"(n));
+  return q;
+}
+
+// Runs in a fresh child, so that the heap is allocated under the
+// current setting of largepages.
+static void
+run(int large, int mb, int n)
+{
+  unsigned long long t0, t;
+  volatile char *p;
+  uint npages, i;
+  char *brk;
+
+  brk = sbrk(0);
+  if((uint)brk % LPGSIZE != 0 && sbrk(LPGSIZE - (uint)brk % LPGSIZE) == (char*)-1)
+    goto nomem;
+  if((p = sbrk(mb * 1024 * 1024)) == (char*)-1)
+    goto nomem;
+  npages = mb * 1024 * 1024 / PGSIZE;
+
+  // Touch every page once first, so only the TLB is being timed.
+  for(i = 0; i < npages; i++)
+    p[i * PGSIZE] = i;
+
+  t0 = rdtsc();
+  for(i = 0; i < n; i++)
+    (void)p[rand() % npages * PGSIZE + (i & (PGSIZE - 1))];
+  t = rdtsc() - t0;
+  printf(1, "BENCH tlb largepages=%d mb=%d accesses=%d cycles=%d\n",
+         large, mb, n, perop(t, n));
+  exit();
+
+nomem:
+  printf(2, "tlbbench: cannot grow heap by %d MB\n", mb);
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, n, large, old;
+
+  mb = argc > 1 ? atoi(argv[1]) : 16;
+  n = argc > 2 ? atoi(argv[2]) : 1000000;
+  if(mb < 4 || n < 1){
+    printf(2, "usage: tlbbench [mb [accesses]]\n");
+    exit();
+  }
+
+  if(sysctl(CTL_LARGEPAGES, &old, 0) < 0){
+    printf(2, "tlbbench: no largepages sysctl\n");
+    exit();
+  }
+  for(large = 0; large <= 1; large++){
+    sysctl(CTL_LARGEPAGES, 0, &large);
+    if(fork() == 0)
+      run(large, mb, n);
+    wait();
+  }
+  sysctl(CTL_LARGEPAGES, 0, &old);
+  exit();
+}
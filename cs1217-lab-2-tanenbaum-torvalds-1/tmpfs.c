@@ -0,0 +1,165 @@
+// In-memory file system.
+//
+// tmpfs keeps files in kernel pages instead of disk blocks, so
+// scratch files cost neither log traffic nor disk writes, and do
+// not survive a reboot.  Its inodes live in the inode cache like
+// disk inodes, with device number TMPDEV; fs.c calls in here
+// wherever it would otherwise touch the disk (ialloc, ilock,
+// iupdate, itrunc, readi, writei).  Directories hold struct
+// dirents like disk directories, so dirlookup(), dirlink() and
+// the system calls work on tmpfs unchanged.  Inode ROOTINO is the
+// root, which mount() hangs on a disk directory.
+//
+// A file's data is a page of pointers to data pages, allocated as
+// it grows, so files are limited to TMPMAXFILE bytes.  Each node
+// is protected by the sleeplock of its in-memory inode, and
+// tmpfs.lock protects allocation.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stat.h"
+
+#define NTNODE     200
+#define TMPMAXPG   (PGSIZE / sizeof(char*))
+#define TMPMAXFILE (TMPMAXPG * PGSIZE)
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct tnode {
+  short type;
+  short major;
+  short minor;
+  short nlink;
+  uint size;
+  char **pages;         // data pages, or 0 if none yet
+};
+
+static struct {
+  struct spinlock lock;
+  struct tnode node[NTNODE];
+} tmpfs;
+
+void
+tmpinit(void)
+{
+  initlock(&tmpfs.lock, "tmpfs");
+  tmpfs.node[ROOTINO].type = T_DIR;
+  tmpfs.node[ROOTINO].nlink = 1;
+}
+
+// Allocate a node of the given type.  Returns its inode number,
+// or 0 if there are none left.
+uint
+tmpialloc(short type)
+{
+  struct tnode *t;
+  uint inum;
+
+  acquire(&tmpfs.lock);
+  for(inum = ROOTINO + 1; inum < NTNODE; inum++){
+    t = &tmpfs.node[inum];
+    if(t->type == 0){
+      memset(t, 0, sizeof(*t));
+      t->type = type;
+      release(&tmpfs.lock);
+      return inum;
+    }
+  }
+  release(&tmpfs.lock);
+  return 0;
+}
+
+// Fill in ip from its node, as ilock() does from the disk.
+void
+tmpiread(struct inode *ip)
+{
+  struct tnode *t = &tmpfs.node[ip->inum];
+
+  ip->type = t->type;
+  ip->major = t->major;
+  ip->minor = t->minor;
+  ip->nlink = t->nlink;
+  ip->size = t->size;
+}
+
+// Copy ip back to its node, freeing the node if ip's type is 0.
+// Caller must hold ip->lock.
+void
+tmpiupdate(struct inode *ip)
+{
+  struct tnode *t = &tmpfs.node[ip->inum];
+
+  t->major = ip->major;
+  t->minor = ip->minor;
+  t->nlink = ip->nlink;
+  t->size = ip->size;
+  acquire(&tmpfs.lock);
+  t->type = ip->type;
+  release(&tmpfs.lock);
+}
+
+// Free ip's data.  Caller must hold ip->lock.
+void
+tmptrunc(struct inode *ip)
+{
+  struct tnode *t = &tmpfs.node[ip->inum];
+  uint i;
+
+  if(t->pages){
+    for(i = 0; i < TMPMAXPG; i++)
+      if(t->pages[i])
+        kfree(t->pages[i]);
+    kfree((char*)t->pages);
+    t->pages = 0;
+  }
+  ip->size = 0;
+  tmpiupdate(ip);
+}
+
+// Read n bytes at off, which readi() has checked against the
+// size.  Caller must hold ip->lock.
+int
+tmpread(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct tnode *t = &tmpfs.node[ip->inum];
+  uint tot, m;
+
+  for(tot = 0; tot < n; tot += m, off += m, dst += m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    memmove(dst, t->pages[off/PGSIZE] + off%PGSIZE, m);
+  }
+  return n;
+}
+
+// Write n bytes at off, which must not be past the end of the
+// file.  Fails if memory runs out, keeping what was written.
+// Caller must hold ip->lock.
+int
+tmpwrite(struct inode *ip, char *src, uint off, uint n)
+{
+  struct tnode *t = &tmpfs.node[ip->inum];
+  uint tot, m;
+  char **pp;
+
+  if(off + n > TMPMAXFILE)
+    return -1;
+  if(t->pages == 0 && n > 0 && (t->pages = (char**)kalloczero()) == 0)
+    return -1;
+  for(tot = 0; tot < n; tot += m, off += m, src += m){
+    pp = &t->pages[off/PGSIZE];
+    if(*pp == 0 && (*pp = kalloc()) == 0)
+      break;
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    memmove(*pp + off%PGSIZE, src, m);
+  }
+  if(off > ip->size){
+    ip->size = off;
+    tmpiupdate(ip);
+  }
+  return tot == n ? n : -1;
+}
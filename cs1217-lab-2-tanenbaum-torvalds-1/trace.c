@@ -0,0 +1,169 @@
+// Scheduler event tracing.
+//
+// Each CPU records events into its own ring buffer.  Only that CPU
+// ever fills slots in its ring: the producer fills a slot and then
+// advances head, and the reader copies slots out and then advances
+// tail.  Readers serialize among themselves with tracelock, and
+// recording takes no lock at all.  A reset is a read that discards
+// everything up to head, and it clears the drop count by
+// remembering where the count stood, so it too writes only what
+// readers own.  When a ring is full new events are dropped and
+// counted, so a slow reader loses the newest events rather than
+// corrupting old ones.
+//
+// Readers copy events into a kernel page under tracelock and out
+// to user space only after releasing it, since the copy may fault.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "schedtrace.h"
+
+#define NTRACE 512   // events per CPU; must be a power of two
+#define TRACEPG (PGSIZE / sizeof(struct traceevent))  // events per copy
+
+struct tracering {
+  volatile uint head;   // next slot to fill, written by the owning CPU
+  volatile uint tail;   // next slot to read, written by readers
+  volatile uint dropped;  // written by the owning CPU
+  uint dropbase;        // dropped at the last reset, written by readers
+  struct traceevent ev[NTRACE];
+};
+
+static struct tracering rings[NCPU];
+static struct spinlock tracelock;
+static volatile int tracing;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+}
+
+// Record an event on this CPU's ring.
+void
+trace(int type, int pid, int arg)
+{
+  struct tracering *r;
+  struct traceevent *e;
+  int id;
+
+  if(!tracing)
+    return;
+
+  pushcli();
+  id = cpuid();
+  r = &rings[id];
+  if(r->head - r->tail >= NTRACE){
+    r->dropped++;
+    popcli();
+    return;
+  }
+  e = &r->ev[r->head & (NTRACE-1)];
+  e->tsc = rdtsc();
+  e->type = type;
+  e->cpu = id;
+  e->pid = pid;
+  e->arg = arg;
+  __sync_synchronize();   // publish the slot before head
+  r->head++;
+  popcli();
+}
+
+// Copy up to n events into buf, merging the per-CPU rings
+// oldest first.  Returns the number of events copied.
+static int
+traceread(struct traceevent *buf, int n)
+{
+  struct tracering *r, *best;
+  uint head[NCPU];
+  int i, got;
+
+  for(i = 0; i < ncpu; i++)
+    head[i] = rings[i].head;
+  __sync_synchronize();   // read slots only after their heads
+
+  for(got = 0; got < n; got++){
+    best = 0;
+    for(i = 0; i < ncpu; i++){
+      r = &rings[i];
+      if(r->tail == head[i])
+        continue;
+      if(best == 0 || r->ev[r->tail & (NTRACE-1)].tsc <
+                      best->ev[best->tail & (NTRACE-1)].tsc)
+        best = r;
+    }
+    if(best == 0)
+      break;
+    buf[got] = best->ev[best->tail & (NTRACE-1)];
+    __sync_synchronize();   // finish the copy before freeing the slot
+    best->tail++;
+  }
+  return got;
+}
+
+// Copy up to n events to user address ubuf, a page at a time.
+// Returns the number copied, or -1 if ubuf is bad.
+static int
+tracecopy(uint ubuf, int n)
+{
+  struct traceevent *kbuf;
+  int got, m;
+
+  if((kbuf = (struct traceevent*)kalloc()) == 0)
+    return -1;
+  for(got = 0; got < n; got += m){
+    acquire(&tracelock);
+    m = traceread(kbuf, n - got < TRACEPG ? n - got : TRACEPG);
+    release(&tracelock);
+    if(m == 0)
+      break;
+    if(copyout(myproc()->pgdir, ubuf + got*sizeof(*kbuf), kbuf, m*sizeof(*kbuf)) < 0){
+      got = -1;
+      break;
+    }
+  }
+  kfree((char*)kbuf);
+  return got;
+}
+
+int
+schedtrace(int op, uint buf, int n)
+{
+  int i, r;
+
+  if(op == TRACE_READ)
+    return tracecopy(buf, n);
+
+  acquire(&tracelock);
+  r = 0;
+  switch(op){
+  case TRACE_OFF:
+    tracing = 0;
+    break;
+  case TRACE_ON:
+    tracing = 0;
+    for(i = 0; i < ncpu; i++){
+      rings[i].tail = rings[i].head;
+      rings[i].dropbase = rings[i].dropped;
+    }
+    tracing = 1;
+    break;
+  case TRACE_DROPPED:
+    for(i = 0; i < ncpu; i++)
+      r += rings[i].dropped - rings[i].dropbase;
+    break;
+  case TRACE_MHZ:
+    r = tscmhz;
+    break;
+  default:
+    r = -1;
+  }
+  release(&tracelock);
+  return r;
+}
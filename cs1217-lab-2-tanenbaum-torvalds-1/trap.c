@@ -8,9 +8,13 @@
 #include "traps.h"
 #include "spinlock.h"
 
+#define CPUID_SEP 0x800    // cpufeatures(): sysenter/sysexit supported
+#define SYSENTER  0x340f   // sysenter's opcode bytes, 0f 34
+
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysentry(void);  // in trapasm.S
 struct spinlock tickslock;
 uint ticks;
 
@@ -29,14 +33,49 @@ tvinit(void)
 void
 idtinit(void)
 {
+  struct cpu *c;
+
   lidt(idt, sizeof(idt));
+
+  // Let the stubs in usys.S enter with sysenter.  It loads %esp
+  // from the MSR, which points at this CPU's ts.esp0, and
+  // sysentry loads the process's kernel stack from there, so
+  // switchuvm() need not touch the MSRs.  A CPU without sysenter
+  // traps on it instead; see sysenterfault().
+  if(!(cpufeatures() & CPUID_SEP))
+    return;
+  c = mycpu();
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+  wrmsr(MSR_SYSENTER_ESP, (uint)&c->ts.esp0);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+}
+
+// Is tf an invalid opcode trap on a user sysenter instruction?
+// If so, turn it into the system call the int path would have
+// made: the stub passes its return address in %edx and its stack
+// pointer in %ecx.
+static int
+sysenterfault(struct trapframe *tf)
+{
+  struct proc *curproc = myproc();
+
+  if(curproc == 0 || (tf->cs&3) != DPL_USER)
+    return 0;
+  if(tf->eip >= curproc->sz || curproc->sz - tf->eip < 2 ||
+     *(ushort*)tf->eip != SYSENTER)
+    return 0;
+  tf->eip = tf->edx;
+  tf->esp = tf->ecx;
+  tf->trapno = T_SYSCALL;
+  return 1;
 }
 
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
-  if(tf->trapno == T_SYSCALL){
+  if(tf->trapno == T_SYSCALL ||
+     (tf->trapno == T_ILLOP && sysenterfault(tf))){
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
@@ -48,20 +87,19 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    profintr(tf);
+    timerintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
-    ideintr();
+    ideintr(0);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE+1:
-    // Bochs generates spurious IDE1 interrupts.
+    // Bochs generates spurious IDE1 interrupts, which find the
+    // secondary channel's queue empty.
+    ideintr(1);
+    lapiceoi();
     break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
@@ -79,7 +117,35 @@ trap(struct trapframe *tf)
     break;
 
   //PAGEBREAK: 13
+  case T_PGFLT:
+    // Writes to copy-on-write pages fault, from user space or
+    // from the kernel copying out to user memory.
+    if(myproc() && (tf->err & 2) && cowfault(myproc()->pgdir, rcr2()) == 0)
+      break;
+    // First touch of a program page.  The kernel prefault()s user
+    // memory before using it, since it may hold spinlocks here.
+    if(myproc() && (tf->cs&3) == DPL_USER && loadfault(rcr2()) == 0)
+      break;
+    // The kernel touched user memory it could not make good, such
+    // as a copy-on-write page with no memory left to copy it to.
+    // Kill the process rather than the kernel.
+    if(myproc() && (tf->cs&3) == 0 && rcr2() < myproc()->sz &&
+       uvmsink(myproc()->pgdir, rcr2()) == 0){
+      cprintf("pid %d %s: kernel fault on addr 0x%x--kill proc\n",
+              myproc()->pid, myproc()->name, rcr2());
+      myproc()->killed = 1;
+      break;
+    }
+    // fall through
   default:
+    if(tf->trapno == T_DEBUG && (tf->cs&3) == 0 &&
+       tf->eip - (uint)sysentry < 8){
+      // sysenter keeps the user's trap flag, so a process that
+      // single-steps into it traps on sysentry's first
+      // instruction.  Carry on without it.
+      tf->eflags &= ~FL_TF;
+      break;
+    }
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -100,10 +166,10 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU when its time slice is over.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     tf->trapno == T_IRQ0+IRQ_TIMER && (timerexpired() || edfpreempt()))
     yield();
 
   // Check if the process has been killed since we yielded
@@ -1,4 +1,11 @@
 // Intel 8250 serial port (UART).
+//
+// Output goes through a transmit ring that the UART drains a FIFO's
+// worth at a time from its transmit-holding-register-empty (THRE)
+// interrupt, so printing does not wait for the serial line.  When
+// the ring is full, uartputc() falls back to draining it by
+// polling.  After uartflush(), as on panic, output is fully
+// synchronous and takes no locks.
 
 #include "types.h"
 #include "defs.h"
@@ -14,15 +21,36 @@
 
 #define COM1    0x3f8
 
+#define IER_RX    0x01      // interrupt enable: received data
+#define IER_THRE  0x02      // interrupt enable: transmitter empty
+#define LSR_RX    0x01      // line status: data ready
+#define LSR_THRE  0x20      // line status: transmitter empty
+
+#define TXBUF   1024        // must be a power of two
+
 static int uart;    // is there a uart?
+static int fifo;    // bytes the transmitter takes at once
+static int txroom;  // bytes it can still take since THRE was last seen
+
+static struct {
+  struct spinlock lock;
+  char buf[TXBUF];
+  uint r;           // next byte to send
+  uint w;           // next free slot
+  int sync;         // set by uartflush(); bypass the ring
+  int ier;          // last value written to the interrupt enable register
+} tx;
 
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on and clear the FIFOs; a 16550A reports them in IIR.
+  outb(COM1+2, 0x07);
+  fifo = (inb(COM1+2) & 0xC0) == 0xC0 ? 16 : 1;
 
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -30,7 +58,8 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  tx.ier = IER_RX;
+  outb(COM1+1, tx.ier);  // Enable receive interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -48,16 +77,74 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Write c to the transmitter.  Once the FIFO's worth since THRE
+// was last seen is used up, wait for THRE again, allowing long
+// enough for a full FIFO to drain at about 1 ms a byte.
+static void
+uartputsync(int c)
+{
+  int i;
+
+  if(txroom == 0){
+    for(i = 0; i < fifo*125 && !(inb(COM1+5) & LSR_THRE); i++)
+      microdelay(10);
+    txroom = fifo;
+  }
+  outb(COM1+0, c);
+  txroom--;
+}
+
+// Move as much of the ring as the transmitter will take, and ask
+// for an interrupt when it has room again if anything is left.
+// Caller must hold tx.lock.
+static void
+uartstart(void)
+{
+  int n, ier;
+
+  if(tx.r != tx.w && (inb(COM1+5) & LSR_THRE))
+    txroom = fifo;
+  for(n = 0; n < txroom && tx.r != tx.w; n++)
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+  txroom -= n;
+  ier = tx.r != tx.w ? IER_RX | IER_THRE : IER_RX;
+  if(ier != tx.ier){
+    tx.ier = ier;
+    outb(COM1+1, ier);
+  }
+}
+
 void
 uartputc(int c)
 {
-  int i;
+  if(!uart)
+    return;
+  if(tx.sync){
+    uartputsync(c);
+    return;
+  }
 
+  acquire(&tx.lock);
+  while(tx.w - tx.r == TXBUF)
+    uartputsync(tx.buf[tx.r++ % TXBUF]);
+  tx.buf[tx.w++ % TXBUF] = c;
+  uartstart();
+  release(&tx.lock);
+}
+
+// Push out everything still in the ring by polling, and send all
+// later output synchronously.  For panic(), which may interrupt a
+// holder of tx.lock, so this takes no lock.
+void
+uartflush(void)
+{
   if(!uart)
     return;
-  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
-    microdelay(10);
-  outb(COM1+0, c);
+  tx.sync = 1;
+  tx.ier = IER_RX;
+  outb(COM1+1, tx.ier);
+  while(tx.r != tx.w)
+    uartputsync(tx.buf[tx.r++ % TXBUF]);
 }
 
 static int
@@ -65,7 +152,7 @@ uartgetc(void)
 {
   if(!uart)
     return -1;
-  if(!(inb(COM1+5) & 0x01))
+  if(!(inb(COM1+5) & LSR_RX))
     return -1;
   return inb(COM1+0);
 }
@@ -74,4 +161,9 @@ void
 uartintr(void)
 {
   consoleintr(uartgetc);
+  if(!uart || tx.sync)
+    return;
+  acquire(&tx.lock);
+  uartstart();
+  release(&tx.lock);
 }
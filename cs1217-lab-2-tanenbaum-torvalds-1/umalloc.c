@@ -3,88 +3,157 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Segregated-fit memory allocator.
+//
+// Requests of up to MAXSMALL bytes are rounded up to a power-of-two
+// size class, and each class keeps its own free list, so malloc()
+// and free() of small blocks are a single list push or pop.  Fresh
+// blocks are bump-allocated from an arena that grows with sbrk() in
+// ARENASIZE steps.
+//
+// Every block starts with a header recording its size class (or,
+// for large blocks, its size), which is all free() needs; it never
+// searches.  Large blocks are kept on a separate first-fit list,
+// since they are rare, in address order so that free() can merge
+// neighbours; malloc() splits off what it does not need.
+
+#define MINSHIFT   3                       // smallest class: 8 bytes
+#define NCLASS     9                       // 8, 16, ..., 2048 bytes
+#define MAXSMALL   (1 << (MINSHIFT + NCLASS - 1))
+#define ARENASIZE  (64*1024)
+#define LARGE      NCLASS                  // class of large blocks
+#define PAGE       4096
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *next;  // free list link (free blocks only)
+    uint size;           // payload bytes
+    uint class;          // size class, or LARGE
   } s;
   Align x;
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+static Header *freelist[NCLASS];
+static Header *largelist;
+static char *arena;     // next free byte of the current arena
+static char *arenaend;  // end of the current arena
 
-void
-free(void *ap)
+// Grab n bytes from the arena, extending it with sbrk if needed:
+// by ARENASIZE if possible, else by just enough.
+static char*
+bump(uint n)
+{
+  char *p;
+  uint need, grow;
+
+  if(arenaend - arena < n){
+    p = sbrk(0);
+    if(p != arenaend)   // someone else moved the break; start over
+      arena = arenaend = p;
+    need = (n - (arenaend - arena) + PAGE - 1) & ~(PAGE - 1);
+    grow = need > ARENASIZE ? need : ARENASIZE;
+    if(sbrk(grow) == (char*)-1){
+      if(grow == need || sbrk(need) == (char*)-1)
+        return 0;
+      grow = need;
+    }
+    arenaend += grow;
+  }
+  p = arena;
+  arena += n;
+  return p;
+}
+
+static void*
+largealloc(uint nbytes)
+{
+  Header *h, *rest, **pp;
+
+  nbytes = (nbytes + sizeof(Header) - 1) / sizeof(Header) * sizeof(Header);
+  for(pp = &largelist; (h = *pp) != 0; pp = &h->s.next){
+    if(h->s.size < nbytes)
+      continue;
+    if(h->s.size - nbytes > sizeof(Header)){
+      // Leave the tail on the list.
+      rest = (Header*)((char*)(h + 1) + nbytes);
+      rest->s.size = h->s.size - nbytes - sizeof(Header);
+      rest->s.class = LARGE;
+      rest->s.next = h->s.next;
+      *pp = rest;
+      h->s.size = nbytes;
+    } else
+      *pp = h->s.next;
+    return (void*)(h + 1);
+  }
+  if((h = (Header*)bump(nbytes + sizeof(Header))) == 0)
+    return 0;
+  h->s.size = nbytes;
+  h->s.class = LARGE;
+  return (void*)(h + 1);
+}
+
+// Put large block h on largelist in address order, merging it
+// with the free blocks just before and after it.
+static void
+largefree(Header *h)
 {
-  Header *bp, *p;
-
-  bp = (Header*)ap - 1;
-  for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-    if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
-      break;
-  if(bp + bp->s.size == p->s.ptr){
-    bp->s.size += p->s.ptr->s.size;
-    bp->s.ptr = p->s.ptr->s.ptr;
+  Header *prev, *p;
+
+  prev = 0;
+  for(p = largelist; p != 0 && p < h; p = p->s.next)
+    prev = p;
+  if(p != 0 && (char*)(h + 1) + h->s.size == (char*)p){
+    h->s.size += sizeof(Header) + p->s.size;
+    h->s.next = p->s.next;
   } else
-    bp->s.ptr = p->s.ptr;
-  if(p + p->s.size == bp){
-    p->s.size += bp->s.size;
-    p->s.ptr = bp->s.ptr;
+    h->s.next = p;
+  if(prev == 0)
+    largelist = h;
+  else if((char*)(prev + 1) + prev->s.size == (char*)h){
+    prev->s.size += sizeof(Header) + h->s.size;
+    prev->s.next = h->s.next;
   } else
-    p->s.ptr = bp;
-  freep = p;
+    prev->s.next = h;
 }
 
-static Header*
-morecore(uint nu)
+void
+free(void *ap)
 {
-  char *p;
-  Header *hp;
+  Header *h;
 
-  if(nu < 4096)
-    nu = 4096;
-  p = sbrk(nu * sizeof(Header));
-  if(p == (char*)-1)
-    return 0;
-  hp = (Header*)p;
-  hp->s.size = nu;
-  free((void*)(hp + 1));
-  return freep;
+  if(ap == 0)
+    return;
+  h = (Header*)ap - 1;
+  if(h->s.class == LARGE){
+    largefree(h);
+    return;
+  }
+  h->s.next = freelist[h->s.class];
+  freelist[h->s.class] = h;
 }
 
 void*
 malloc(uint nbytes)
 {
-  Header *p, *prevp;
-  uint nunits;
+  Header *h;
+  uint c;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
-  for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
-    if(p->s.size >= nunits){
-      if(p->s.size == nunits)
-        prevp->s.ptr = p->s.ptr;
-      else {
-        p->s.size -= nunits;
-        p += p->s.size;
-        p->s.size = nunits;
-      }
-      freep = prevp;
-      return (void*)(p + 1);
-    }
-    if(p == freep)
-      if((p = morecore(nunits)) == 0)
-        return 0;
+  if(nbytes > MAXSMALL)
+    return largealloc(nbytes);
+
+  for(c = 0; (1 << (MINSHIFT + c)) < nbytes; c++)
+    ;
+  if((h = freelist[c]) != 0){
+    freelist[c] = h->s.next;
+    return (void*)(h + 1);
   }
+  if((h = (Header*)bump(sizeof(Header) + (1 << (MINSHIFT + c)))) == 0)
+    return 0;
+  h->s.size = 1 << (MINSHIFT + c);
+  h->s.class = c;
+  return (void*)(h + 1);
 }
@@ -1,7 +1,11 @@
 struct stat;
 struct pstat;
 struct benchinfo;
+struct traceevent;
 struct rtcdate;
+struct iovec;
+struct profsample;
+struct aioring;
 
 // system calls
 int fork(void);
@@ -28,8 +32,22 @@ int uptime(void);
 int setpriority(int, int);
 int getpriority(int);
 int settickets(int);
-int getpinfo(struct pstat*);
+int getpinfo(struct pstat*, int);
 int benchinfo(struct benchinfo*);
+int schedtrace(int, struct traceevent*, int);
+int nanosleep(int, int);
+int setdeadline(int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int sendfile(int, int, int);
+int sysctl(int, int*, int*);
+int profctl(int, struct profsample*, int);
+int aiosetup(struct aioring*);
+int aioenter(int);
+int mount(char*);
+int tickctl(int, int, int);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
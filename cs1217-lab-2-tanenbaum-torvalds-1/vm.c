@@ -10,6 +10,20 @@
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// Absorbs the rest of a kernel access to user memory that faulted
+// and could not be made good; see uvmsink().
+static char *sinkpage;
+
+// allocuvm() maps each whole, aligned 4 MB of new user memory
+// with a single large (PSE) page when kalloclarge()'s pool has a
+// block free, saving a page table page and, more
+// importantly, 1023 TLB entries.  Code that works on one 4 KB
+// page of it goes through walkpgdir(), which splits it back into
+// 4 KB pages; lookups that only read the mapping use lookup()
+// instead.  Set to 0 (sysctl CTL_LARGEPAGES) to always use 4 KB
+// pages.
+int largepages = 1;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -29,9 +43,59 @@ seginit(void)
   lgdt(c->gdt, sizeof(c->gdt));
 }
 
+// Replace the large page mapped by *pde with a page table that
+// maps the same 4 KB pages.  Returns -1 if out of memory.
+static int
+splitpde(pde_t *pde, const void *va)
+{
+  pte_t *pgtab;
+  uint pa, flags, i;
+
+  if((pgtab = (pte_t*)kalloc()) == 0)
+    return -1;
+  pa = PTE_ADDR(*pde);
+  flags = PTE_FLAGS(*pde) & ~PTE_PS;
+  for(i = 0; i < NPTENTRIES; i++)
+    pgtab[i] = (pa + i*PGSIZE) | flags;
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  invlpg((void*)va);
+  return 0;
+}
+
+// Cut the large page mapped by *pde down to its pages below va,
+// freeing the rest.  One of the freed pages that nothing else
+// holds becomes the page table, so this needs no memory unless
+// all of them are pinned.  Returns -1 if out of memory.
+static int
+shrinkpde(pde_t *pde, uint va)
+{
+  pte_t *pgtab;
+  uint pa, flags, i, j, n;
+
+  pa = PTE_ADDR(*pde);
+  flags = PTE_FLAGS(*pde) & ~PTE_PS;
+  n = (va % LPGSIZE) / PGSIZE;    // pages kept
+  for(i = NPTENTRIES; i > n; i--)
+    if(krefs(P2V(pa + (i-1)*PGSIZE)) == 1)
+      break;
+  if(i == n)
+    return splitpde(pde, (void*)va);
+  pgtab = (pte_t*)P2V(pa + (i-1)*PGSIZE);
+  memset(pgtab, 0, PGSIZE);
+  for(j = 0; j < n; j++)
+    pgtab[j] = (pa + j*PGSIZE) | flags;
+  *pde = V2P(pgtab) | PTE_P | PTE_W | PTE_U;
+  invlpg((void*)va);
+  for(j = n; j < NPTENTRIES; j++)
+    if(j != i-1)
+      kfree(P2V(pa + j*PGSIZE));
+  return 0;
+}
+
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages.  A large page
+// containing va is split first.
 static pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
@@ -39,13 +103,14 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if((*pde & (PTE_P|PTE_PS)) == (PTE_P|PTE_PS) && splitpde(pde, va) < 0)
+    return 0;
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloczero()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -54,6 +119,32 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   return &pgtab[PTX(va)];
 }
 
+// Return the entry that maps va in pgdir without changing it:
+// the page directory entry if va is in a large page, else the
+// PTE, or 0 if there is no page table.
+static pte_t*
+lookup(pde_t *pgdir, uint va)
+{
+  pde_t *pde;
+
+  pde = &pgdir[PDX(va)];
+  if(!(*pde & PTE_P))
+    return 0;
+  if(*pde & PTE_PS)
+    return pde;
+  return &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(va)];
+}
+
+// Physical address of the 4 KB page containing va, which entry e
+// from lookup() maps.
+static uint
+pagepa(uint e, uint va)
+{
+  if(e & PTE_PS)
+    return PTE_ADDR(e) + (PGROUNDDOWN(va) & (LPGSIZE-1));
+  return PTE_ADDR(e);
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
@@ -121,9 +212,8 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloczero()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -141,6 +231,8 @@ void
 kvmalloc(void)
 {
   kpgdir = setupkvm();
+  if((sinkpage = kalloc()) == 0)
+    panic("kvmalloc");
   switchkvm();
 }
 
@@ -186,36 +278,73 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloczero();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
+// Map sz bytes of ip starting at offset at addr, using pages from
+// the page cache that other processes may share.  addr must be
+// page-aligned and the pages must not be mapped yet.  Writable
+// segments are mapped copy-on-write; see cowfault().
 int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
+mapuvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz,
+       int writable)
 {
-  uint i, pa, n;
-  pte_t *pte;
+  uint i, n, perm;
+  char *page;
 
   if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
+    panic("mapuvm: addr must be page aligned");
+  perm = PTE_U | PTE_SHARED | (writable ? PTE_COW : 0);
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
     if(sz - i < PGSIZE)
       n = sz - i;
     else
       n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
+    if((page = pcacheget(ip, offset+i, n)) == 0)
+      return -1;
+    if(mappages(pgdir, addr+i, PGSIZE, V2P(page), perm) < 0){
+      kfree(page);
       return -1;
+    }
   }
   return 0;
 }
 
+// Handle a write to the copy-on-write page at va by giving the
+// process its own writable copy, or by simply making the page
+// writable if nobody else maps it any more.  Returns -1 if va is
+// not a copy-on-write page or memory is exhausted.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa, flags;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = lookup(pgdir, va)) == 0)
+    return -1;
+  // Another CPU may have broken the sharing already, through
+  // copyout() on this page table, leaving us a stale TLB entry.
+  if((*pte & (PTE_P|PTE_U|PTE_W)) == (PTE_P|PTE_U|PTE_W))
+    return 0;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  flags = (PTE_FLAGS(*pte) & ~(PTE_SHARED|PTE_COW)) | PTE_W;
+  if(krefs(P2V(pa)) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | flags;
+    kfree(P2V(pa));
+  } else
+    *pte = pa | flags;
+  invlpg((char*)PGROUNDDOWN(va));
+  return 0;
+}
+
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,13 +360,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(largepages && a % LPGSIZE == 0 && newsz - a >= LPGSIZE &&
+       !(pgdir[PDX(a)] & PTE_P) && (mem = kalloclarge()) != 0){
+      memset(mem, 0, LPGSIZE);
+      pgdir[PDX(a)] = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+      a += LPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kalloczero();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -248,10 +383,33 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Free the user memory *pde maps, a large page or a page table's
+// worth of pages, and the page table.
+static void
+freepde(pde_t *pde)
+{
+  pte_t *pgtab;
+  uint i;
+
+  if(*pde & PTE_PS){
+    for(i = 0; i < NPTENTRIES; i++)
+      kfree(P2V(PTE_ADDR(*pde) + i*PGSIZE));
+  } else {
+    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+    for(i = 0; i < NPTENTRIES; i++)
+      if(pgtab[i] & PTE_P)
+        kfree(P2V(PTE_ADDR(pgtab[i])));
+    kfree((char*)pgtab);
+  }
+  *pde = 0;
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size, or 0 if a large
+// page had to be split and there was no memory for it, in which
+// case nothing has been freed.
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -262,7 +420,20 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     return oldsz;
 
   a = PGROUNDUP(newsz);
+  // A large page that only partly goes is cut down first.
+  if(a % LPGSIZE != 0 && a < oldsz &&
+     (pgdir[PDX(a)] & (PTE_P|PTE_PS)) == (PTE_P|PTE_PS) &&
+     shrinkpde(&pgdir[PDX(a)], a) < 0)
+    return 0;
   for(; a  < oldsz; a += PGSIZE){
+    if(a % LPGSIZE == 0 &&
+       (oldsz - a >= LPGSIZE || (pgdir[PDX(a)] & PTE_PS))){
+      // All of the 4 MB goes, page table included.
+      if(pgdir[PDX(a)] & PTE_P)
+        freepde(&pgdir[PDX(a)]);
+      a += LPGSIZE - PGSIZE;
+      continue;
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
@@ -323,12 +494,27 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
+    if((pgdir[PDX(i)] & PTE_PS) && (mem = kalloclarge()) != 0){
+      // Copy a large page whole; without the memory for one, the
+      // code below copies it a page at a time.
+      memmove(mem, P2V(PTE_ADDR(pgdir[PDX(i)])), LPGSIZE);
+      d[PDX(i)] = V2P(mem) | PTE_FLAGS(pgdir[PDX(i)]);
+      i += LPGSIZE - PGSIZE;
+      continue;
+    }
+    if((pte = lookup(pgdir, i)) == 0)
       panic("copyuvm: pte should exist");
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
+      continue;   // not loaded yet; the child loads its own
+    pa = pagepa(*pte, i);
+    flags = PTE_FLAGS(*pte) & ~PTE_PS;
+    if(flags & PTE_SHARED){
+      // Page-cache page; share it rather than copy it.
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+        goto bad;
+      kref(P2V(pa));
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
@@ -351,12 +537,12 @@ uva2ka(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
 
-  pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  pte = lookup(pgdir, (uint)uva);
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  return (char*)P2V(PTE_ADDR(*pte));
+  return (char*)P2V(pagepa(*pte, (uint)uva));
 }
 
 // Copy len bytes from p to user address va in page table pgdir.
@@ -367,12 +553,16 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    if((pte = lookup(pgdir, va0)) != 0 && (*pte & PTE_COW) &&
+       cowfault(pgdir, va0) < 0)
+      return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
-    if(pa0 == 0)
+    if(pa0 == 0 || (*pte & PTE_W) == 0)
       return -1;
     n = PGSIZE - (va - va0);
     if(n > len)
@@ -385,6 +575,97 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
+// Copy len bytes from user address va in page table pgdir to p.
+int
+copyin(pde_t *pgdir, void *p, uint va, uint len)
+{
+  char *buf, *pa0;
+  uint n, va0;
+
+  buf = (char*)p;
+  while(len > 0){
+    va0 = (uint)PGROUNDDOWN(va);
+    pa0 = uva2ka(pgdir, (char*)va0);
+    if(pa0 == 0)
+      return -1;
+    n = PGSIZE - (va - va0);
+    if(n > len)
+      n = len;
+    memmove(buf, pa0 + (va - va0), n);
+    len -= n;
+    buf += n;
+    va = va0 + PGSIZE;
+  }
+  return 0;
+}
+
+// Make the n bytes at va in the current page table writable by
+// the kernel ahead of time, breaking copy-on-write sharing.
+// Returns -1 if some page is not mapped writable, or there is no
+// memory to copy a shared one.
+int
+uvmwritable(pde_t *pgdir, uint va, uint n)
+{
+  pte_t *pte;
+  uint a;
+
+  if(n == 0)
+    return 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    if(a >= KERNBASE || (pte = lookup(pgdir, a)) == 0)
+      return -1;
+    if((*pte & PTE_COW) && cowfault(pgdir, a) < 0)
+      return -1;
+    if((*pte & (PTE_P|PTE_U|PTE_W)) != (PTE_P|PTE_U|PTE_W))
+      return -1;
+  }
+  return 0;
+}
+
+// The kernel faulted on user address va of the current page table
+// and the process is to be killed.  Map the sink page at va in
+// place of whatever was there, so the kernel's access completes
+// and the system call can finish.  Returns -1 if va has no page
+// table.
+int
+uvmsink(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  if(va >= KERNBASE || (pte = lookup(pgdir, va)) == 0 || (*pte & PTE_PS))
+    return -1;
+  if(*pte & PTE_P)
+    kfree(P2V(PTE_ADDR(*pte)));
+  kref(sinkpage);
+  *pte = V2P(sinkpage) | PTE_P | PTE_W;
+  invlpg((char*)PGROUNDDOWN(va));
+  return 0;
+}
+
+// Return the kernel address of the user page at va, with a
+// reference that keeps it allocated until the caller kfree()s it.
+// If write is set the page must be writable, and copy-on-write
+// sharing is broken first, so pgdir must be the current page
+// table.  Returns 0 if va is not mapped (writable).
+char*
+uvmpin(pde_t *pgdir, uint va, int write)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = lookup(pgdir, va)) == 0)
+    return 0;
+  if(write && (*pte & PTE_COW) && cowfault(pgdir, va) < 0)
+    return 0;
+  if((*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+    return 0;
+  if(write && !(*pte & PTE_W))
+    return 0;
+  mem = P2V(pagepa(*pte, va));
+  kref(mem);
+  return mem;
+}
+
 //PAGEBREAK!
 // Blank page.
 //PAGEBREAK!
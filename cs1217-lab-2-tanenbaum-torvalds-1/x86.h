@@ -144,6 +144,50 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline void
+invlpg(void *va)
+{
+  asm volatile("invlpg (%0)" : : "r" (va) : "memory");
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+static inline void
+wrmsr(uint msr, uint64 val)
+{
+  asm volatile("wrmsr" : : "c" (msr), "a" ((uint)val), "d" ((uint)(val >> 32)));
+}
+
+// Feature flags (%edx) from cpuid leaf 1.
+static inline uint
+cpufeatures(void)
+{
+  uint a, b, c, d;
+
+  asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1));
+  return d;
+}
+
+// Divide n by d using divl.  Neither the kernel nor user programs
+// link against libgcc, so plain 64-bit division is unavailable.
+static inline uint64
+udiv64(uint64 n, uint d)
+{
+  uint qhi, qlo, r;
+
+  qhi = (uint)(n >> 32) / d;
+  r = (uint)(n >> 32) % d;
+  asm("divl %4" : "=a" (qlo), "=d" (r) : "0" ((uint)n), "1" (r), "rm" (d));
+  return ((uint64)qhi << 32) | qlo;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().